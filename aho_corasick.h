@@ -0,0 +1,181 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "string.h"
+
+// Finds all occurrences of many patterns with a single pass over the text
+class AhoCorasick {
+  public:
+    struct Match {
+        // index of the pattern in the vector passed to the constructor
+        size_t pattern_id;
+        // position of the first symbol of the occurrence
+        size_t position;
+    };
+
+  private:
+    using State = uint32_t;
+
+    static constexpr State ROOT = 0;
+    static constexpr State NO_STATE = UINT32_MAX;
+    static constexpr size_t ALPHABET_SIZE = 256;
+
+    // only bytes present in patterns get their own class, all the others
+    // share class 0, so a table row is as short as the patterns allow
+    uint16_t byte_class[ALPHABET_SIZE];
+    size_t class_count;
+
+    // transitions[state * class_count + class] is the next state,
+    // failure links are already resolved into it
+    std::vector<State> transitions;
+
+    // patterns ending exactly in a state: output_ids[output_begin[s], output_begin[s + 1])
+    std::vector<size_t> output_begin;
+    std::vector<size_t> output_ids;
+
+    // nearest state on the failure chain which has its own outputs
+    std::vector<State> output_link;
+
+    std::vector<size_t> pattern_sizes;
+
+    size_t state_count() const;
+
+    State add_state();
+
+    void build_classes(const std::vector<String>& patterns);
+
+    void build_links(const std::vector<std::vector<size_t>>& own_outputs);
+
+  public:
+    explicit AhoCorasick(const std::vector<String>& patterns);
+
+    size_t pattern_count() const;
+
+    // callback(const Match&) is called for every occurrence in order of
+    // their ends, an empty pattern matches at every position including size()
+    template <typename Callback>
+    void for_each_match(StringView text, Callback callback) const;
+
+    std::vector<Match> find_all(StringView text) const;
+};
+
+size_t AhoCorasick::state_count() const {
+    return output_link.size();
+}
+
+AhoCorasick::State AhoCorasick::add_state() {
+    transitions.resize(transitions.size() + class_count, NO_STATE);
+    output_link.push_back(NO_STATE);
+    return static_cast<State>(state_count() - 1);
+}
+
+void AhoCorasick::build_classes(const std::vector<String>& patterns) {
+    std::fill(byte_class, byte_class + ALPHABET_SIZE, 0);
+
+    class_count = 1;
+    for (const String& pattern : patterns) {
+        for (size_t i = 0; i < pattern.size(); ++i) {
+            uint16_t& current = byte_class[static_cast<unsigned char>(pattern[i])];
+            if (current == 0) current = static_cast<uint16_t>(class_count++);
+        }
+    }
+}
+
+/* Breadth-first order guarantees that the failure state of a node is
+ * already complete when the node is processed, so missing transitions
+ * are copied from it and the table becomes a DFA.
+ * */
+void AhoCorasick::build_links(const std::vector<std::vector<size_t>>& own_outputs) {
+    std::vector<State> fail(state_count(), ROOT);
+    std::vector<State> order;
+    order.reserve(state_count());
+    order.push_back(ROOT);
+
+    for (size_t index = 0; index < order.size(); ++index) {
+        State state = order[index];
+        State* row = transitions.data() + state * class_count;
+        const State* fail_row = transitions.data() + fail[state] * class_count;
+
+        for (size_t c = 0; c < class_count; ++c) {
+            if (row[c] == NO_STATE) {
+                row[c] = state == ROOT ? ROOT : fail_row[c];
+                continue;
+            }
+
+            State child = row[c];
+            fail[child] = state == ROOT ? ROOT : fail_row[c];
+            order.push_back(child);
+        }
+
+        if (state != ROOT) {
+            State next = fail[state];
+            output_link[state] = own_outputs[next].empty() ? output_link[next] : next;
+        }
+    }
+
+    output_begin.assign(1, 0);
+    for (size_t state = 0; state < state_count(); ++state) {
+        output_ids.insert(output_ids.end(), own_outputs[state].begin(), own_outputs[state].end());
+        output_begin.push_back(output_ids.size());
+    }
+}
+
+AhoCorasick::AhoCorasick(const std::vector<String>& patterns) {
+    build_classes(patterns);
+    add_state();
+
+    std::vector<std::vector<size_t>> own_outputs(1);
+    for (size_t id = 0; id < patterns.size(); ++id) {
+        const String& pattern = patterns[id];
+        State state = ROOT;
+
+        for (size_t i = 0; i < pattern.size(); ++i) {
+            size_t cell = state * class_count + byte_class[static_cast<unsigned char>(pattern[i])];
+            if (transitions[cell] == NO_STATE) {
+                // add_state may reallocate transitions, so index it again afterwards
+                State child = add_state();
+                transitions[cell] = child;
+                own_outputs.emplace_back();
+            }
+            state = transitions[cell];
+        }
+
+        own_outputs[state].push_back(id);
+        pattern_sizes.push_back(pattern.size());
+    }
+
+    build_links(own_outputs);
+}
+
+size_t AhoCorasick::pattern_count() const {
+    return pattern_sizes.size();
+}
+
+template <typename Callback>
+void AhoCorasick::for_each_match(StringView text, Callback callback) const {
+    const char* data = text.data();
+    const State* table = transitions.data();
+    State state = ROOT;
+
+    for (size_t end = 0; ; ++end) {
+        for (State current = state; current != NO_STATE; current = output_link[current]) {
+            for (size_t i = output_begin[current]; i < output_begin[current + 1]; ++i) {
+                size_t id = output_ids[i];
+                callback(Match{id, end - pattern_sizes[id]});
+            }
+        }
+
+        if (end == text.size()) break;
+        state = table[state * class_count + byte_class[static_cast<unsigned char>(data[end])]];
+    }
+}
+
+std::vector<AhoCorasick::Match> AhoCorasick::find_all(StringView text) const {
+    std::vector<Match> matches;
+    for_each_match(text, [&matches](const Match& match) {
+        matches.push_back(match);
+    });
+    return matches;
+}
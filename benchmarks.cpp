@@ -0,0 +1,244 @@
+#include <benchmark/benchmark.h>
+#include <sstream>
+#include <string>
+#include "parallel_find.h"
+#include "split.h"
+#include "string.h"
+
+// Every benchmark is instantiated for String and for std::string as a baseline.
+// The argument is the size of the strings involved
+
+const int64_t MIN_SIZE = 8;
+const int64_t MAX_SIZE = 1 << 20;
+
+// text over a small alphabet, so searches meet many partial matches
+template <typename StringType>
+StringType make_text(size_t size) {
+    StringType result(size, 'a');
+    for (size_t i = 0; i < size; ++i) {
+        result[i] = 'a' + (i * 7 + i / 13) % 4;
+    }
+    return result;
+}
+
+template <typename StringType>
+void BM_Construct(benchmark::State& state) {
+    std::string source(state.range(0), 'a');
+    for (auto _ : state) {
+        StringType s(source.c_str());
+        benchmark::DoNotOptimize(s.data());
+    }
+}
+
+template <typename StringType>
+void BM_AppendChar(benchmark::State& state) {
+    for (auto _ : state) {
+        StringType s;
+        for (int64_t i = 0; i < state.range(0); ++i) {
+            s += 'a';
+        }
+        benchmark::DoNotOptimize(s.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template <typename StringType>
+void BM_AppendString(benchmark::State& state) {
+    StringType piece = make_text<StringType>(16);
+    for (auto _ : state) {
+        StringType s;
+        for (int64_t i = 0; i < state.range(0) / 16; ++i) {
+            s += piece;
+        }
+        benchmark::DoNotOptimize(s.data());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+template <typename StringType>
+void BM_Concatenate(benchmark::State& state) {
+    StringType piece = make_text<StringType>(state.range(0));
+    for (auto _ : state) {
+        StringType s = piece + piece + piece + piece;
+        benchmark::DoNotOptimize(s.data());
+    }
+}
+
+void BM_ConcatPieces(benchmark::State& state) {
+    String piece = make_text<String>(state.range(0));
+    for (auto _ : state) {
+        String s = String::concat(piece, ':', piece, ':', piece, '\n');
+        benchmark::DoNotOptimize(s.data());
+    }
+}
+
+template <typename StringType>
+void BM_FindMissing(benchmark::State& state) {
+    StringType text = make_text<StringType>(state.range(0));
+    StringType needle = make_text<StringType>(8);
+    needle[7] = 'z';
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(text.find(needle));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+template <typename StringType>
+void BM_FindLongNeedle(benchmark::State& state) {
+    StringType text = make_text<StringType>(state.range(0));
+    StringType needle = make_text<StringType>(64);
+    needle[63] = 'z';
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(text.find(needle));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+template <typename StringType>
+void BM_RFindMissing(benchmark::State& state) {
+    StringType text = make_text<StringType>(state.range(0));
+    StringType needle = make_text<StringType>(8);
+    needle[0] = 'z';
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(text.rfind(needle));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+void BM_SearcherFindLongNeedle(benchmark::State& state) {
+    String text = make_text<String>(state.range(0));
+    String needle = make_text<String>(64);
+    needle[63] = 'z';
+    String::Searcher searcher(needle);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(searcher.find_in(text));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+void BM_ParallelFindMissing(benchmark::State& state) {
+    String text = make_text<String>(state.range(0));
+    String needle = make_text<String>(8);
+    needle[7] = 'z';
+    ParallelSearcher searcher(needle);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(searcher.find_in(text));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+template <typename StringType>
+void BM_Substr(benchmark::State& state) {
+    StringType text = make_text<StringType>(state.range(0) * 2);
+    for (auto _ : state) {
+        StringType part = text.substr(state.range(0) / 2, state.range(0));
+        benchmark::DoNotOptimize(part.data());
+    }
+}
+
+template <typename StringType>
+void BM_CompareEqual(benchmark::State& state) {
+    StringType left = make_text<StringType>(state.range(0));
+    StringType right = left;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(left == right);
+        benchmark::DoNotOptimize(left < right);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0) * 2);
+}
+
+template <typename StringType>
+void BM_Extract(benchmark::State& state) {
+    std::string words;
+    std::string word(state.range(0), 'a');
+    for (size_t i = 0; i < 16; ++i) {
+        words += word + ' ';
+    }
+
+    for (auto _ : state) {
+        std::istringstream in(words);
+        StringType s;
+        while (in >> s) {
+            benchmark::DoNotOptimize(s.data());
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * words.size());
+}
+
+void BM_SplitWhitespace(benchmark::State& state) {
+    String text;
+    while (text.size() < static_cast<size_t>(state.range(0))) {
+        text += "word\tand  another\n";
+    }
+    std::vector<StringView> pieces;
+    for (auto _ : state) {
+        pieces.clear();
+        split_whitespace(text).split_into(pieces);
+        benchmark::DoNotOptimize(pieces.data());
+    }
+    state.SetBytesProcessed(state.iterations() * text.size());
+}
+
+void BM_Format(benchmark::State& state) {
+    String name = make_text<String>(state.range(0));
+    for (auto _ : state) {
+        String line = String::format("{}: {} ms, {} bytes\n", name, 0.125, 4096);
+        benchmark::DoNotOptimize(line.data());
+    }
+}
+
+void BM_ToLower(benchmark::State& state) {
+    String text = make_text<String>(state.range(0));
+    text.to_upper();
+    for (auto _ : state) {
+        String lower = to_lower(text);
+        benchmark::DoNotOptimize(lower.data());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+void BM_AppendNumbers(benchmark::State& state) {
+    for (auto _ : state) {
+        String s;
+        for (int64_t i = 0; i < state.range(0); ++i) {
+            s.append_int(i * 7919).append_double(i * 0.25);
+        }
+        benchmark::DoNotOptimize(s.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0) * 2);
+}
+
+template <typename StringType>
+void BM_ShrinkToFit(benchmark::State& state) {
+    for (auto _ : state) {
+        StringType s(state.range(0), 'a');
+        s += 'b';
+        s.shrink_to_fit();
+        benchmark::DoNotOptimize(s.data());
+    }
+}
+
+#define STRING_BENCHMARK(name, max_size) \
+    BENCHMARK_TEMPLATE(name, String)->RangeMultiplier(8)->Range(MIN_SIZE, max_size); \
+    BENCHMARK_TEMPLATE(name, std::string)->RangeMultiplier(8)->Range(MIN_SIZE, max_size)
+
+STRING_BENCHMARK(BM_Construct, MAX_SIZE);
+STRING_BENCHMARK(BM_AppendChar, MAX_SIZE);
+STRING_BENCHMARK(BM_AppendString, MAX_SIZE);
+STRING_BENCHMARK(BM_Concatenate, MAX_SIZE);
+BENCHMARK(BM_ConcatPieces)->RangeMultiplier(8)->Range(MIN_SIZE, MAX_SIZE);
+STRING_BENCHMARK(BM_FindMissing, MAX_SIZE);
+STRING_BENCHMARK(BM_FindLongNeedle, MAX_SIZE);
+STRING_BENCHMARK(BM_RFindMissing, MAX_SIZE);
+BENCHMARK(BM_SearcherFindLongNeedle)->RangeMultiplier(8)->Range(MIN_SIZE, MAX_SIZE);
+BENCHMARK(BM_ParallelFindMissing)->RangeMultiplier(8)->Range(MAX_SIZE, MAX_SIZE << 8)->UseRealTime();
+STRING_BENCHMARK(BM_Substr, MAX_SIZE);
+STRING_BENCHMARK(BM_CompareEqual, MAX_SIZE);
+STRING_BENCHMARK(BM_Extract, 4096);
+STRING_BENCHMARK(BM_ShrinkToFit, MAX_SIZE);
+BENCHMARK(BM_AppendNumbers)->RangeMultiplier(8)->Range(MIN_SIZE, MAX_SIZE >> 6);
+BENCHMARK(BM_Format)->RangeMultiplier(8)->Range(MIN_SIZE, MAX_SIZE);
+BENCHMARK(BM_ToLower)->RangeMultiplier(8)->Range(MIN_SIZE, MAX_SIZE);
+BENCHMARK(BM_SplitWhitespace)->RangeMultiplier(8)->Range(MIN_SIZE, MAX_SIZE);
+
+BENCHMARK_MAIN();
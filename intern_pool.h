@@ -0,0 +1,180 @@
+#pragma once
+
+#include <mutex>
+#include <unordered_map>
+
+#include "string.h"
+
+class StringInternPool;
+
+// Handle to an immutable string owned by a StringInternPool. Equal texts
+// from one pool share one handle value, so comparison and hashing do not
+// look at the text. Handles of different pools must not be compared
+class InternedString {
+  private:
+    friend class StringInternPool;
+
+    struct Entry {
+        String text;
+        size_t hash;
+
+        Entry(StringView text, size_t hash);
+    };
+
+    // nullptr for the empty string, the same for every pool
+    const Entry* entry;
+
+    explicit InternedString(const Entry* entry);
+
+  public:
+    InternedString();
+
+    StringView view() const;
+
+    operator StringView() const;
+
+    const char* data() const;
+
+    size_t size() const;
+
+    bool empty() const;
+
+    // hash of the text, the same as String::hash, computed once by the pool
+    size_t hash() const;
+
+    friend bool operator==(InternedString left, InternedString right);
+
+    friend bool operator!=(InternedString left, InternedString right);
+};
+
+/* Texts are split into shards by hash, every shard has its own lock,
+ * so threads interning different strings rarely wait for each other.
+ * Interned texts live until the pool is destroyed.
+ * */
+class StringInternPool {
+  private:
+    static constexpr size_t SHARD_COUNT = 64;
+
+    // the hash is kept in the key, so the table does not compute it again
+    struct Key {
+        StringView text;
+        size_t hash;
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+
+    struct KeyEqual {
+        bool operator()(const Key& left, const Key& right) const;
+    };
+
+    struct Shard {
+        mutable std::mutex lock;
+        // keys refer to the text of the entry they map to
+        std::unordered_map<Key, InternedString::Entry*, KeyHash, KeyEqual> entries;
+    };
+
+    Shard shards[SHARD_COUNT];
+
+  public:
+    StringInternPool() = default;
+
+    StringInternPool(const StringInternPool&) = delete;
+
+    StringInternPool& operator=(const StringInternPool&) = delete;
+
+    // safe to call from many threads at once
+    InternedString intern(StringView text);
+
+    // number of distinct non-empty texts
+    size_t size() const;
+
+    ~StringInternPool();
+};
+
+InternedString::Entry::Entry(StringView text, size_t hash): text(text), hash(hash) {}
+
+InternedString::InternedString(const Entry* entry): entry(entry) {}
+
+InternedString::InternedString(): entry(nullptr) {}
+
+StringView InternedString::view() const {
+    return entry == nullptr ? StringView() : StringView(entry->text);
+}
+
+InternedString::operator StringView() const {
+    return view();
+}
+
+const char* InternedString::data() const {
+    return view().data();
+}
+
+size_t InternedString::size() const {
+    return entry == nullptr ? 0 : entry->text.size();
+}
+
+bool InternedString::empty() const {
+    return size() == 0;
+}
+
+size_t InternedString::hash() const {
+    return entry == nullptr ? StringView().hash() : entry->hash;
+}
+
+bool operator==(InternedString left, InternedString right) {
+    return left.entry == right.entry;
+}
+
+bool operator!=(InternedString left, InternedString right) {
+    return !(left == right);
+}
+
+template <>
+struct std::hash<InternedString> {
+    size_t operator()(InternedString value) const {
+        return value.hash();
+    }
+};
+
+size_t StringInternPool::KeyHash::operator()(const Key& key) const {
+    return key.hash;
+}
+
+bool StringInternPool::KeyEqual::operator()(const Key& left, const Key& right) const {
+    return left.hash == right.hash && left.text == right.text;
+}
+
+InternedString StringInternPool::intern(StringView text) {
+    if (text.empty()) return InternedString();
+
+    size_t hash = text.hash();
+    // low bits pick the bucket inside the table, so the shard takes the high ones
+    Shard& shard = shards[(hash >> (sizeof(size_t) * 4)) % SHARD_COUNT];
+    std::lock_guard<std::mutex> guard(shard.lock);
+
+    auto found = shard.entries.find(Key{text, hash});
+    if (found != shard.entries.end()) return InternedString(found->second);
+
+    InternedString::Entry* entry = new InternedString::Entry(text, hash);
+    shard.entries.emplace(Key{entry->text, hash}, entry);
+    return InternedString(entry);
+}
+
+size_t StringInternPool::size() const {
+    size_t result = 0;
+    for (const Shard& shard : shards) {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        result += shard.entries.size();
+    }
+    return result;
+}
+
+StringInternPool::~StringInternPool() {
+    for (Shard& shard : shards) {
+        for (auto& item : shard.entries) {
+            delete item.second;
+        }
+    }
+}
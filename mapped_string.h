@@ -0,0 +1,189 @@
+#pragma once
+
+#include <cerrno>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "string.h"
+
+/* Read-only string backed by a file mapped into memory: nothing is copied
+ * on construction, pages are read by the kernel when they are touched.
+ * Has the const part of the String API, substr returns a view.
+ * Like StringView, the data is not followed by TERMINATE_SYMBOL.
+ * The file must not be truncated while it is mapped.
+ * */
+class MappedString {
+  public:
+    // how the pages are going to be read, a hint for the kernel readahead
+    enum class AccessPattern {
+        NORMAL,
+        SEQUENTIAL,
+        RANDOM
+    };
+
+  private:
+    // nullptr for empty files, they can't be mapped
+    const char* mapped_data;
+    size_t mapped_size;
+
+    void swap(MappedString& other);
+
+  public:
+    MappedString();
+
+    // throws std::system_error if the file can't be opened or mapped
+    explicit MappedString(const char* path, AccessPattern pattern=AccessPattern::SEQUENTIAL);
+
+    MappedString(const MappedString&) = delete;
+
+    MappedString& operator=(const MappedString&) = delete;
+
+    MappedString(MappedString&& source) noexcept;
+
+    MappedString& operator=(MappedString&& source) noexcept;
+
+    void advise(AccessPattern pattern) const;
+
+    operator StringView() const;
+
+    const char& operator[](size_t index) const;
+
+    const char* data() const;
+
+    size_t size() const;
+
+    size_t length() const;
+
+    bool empty() const;
+
+    const char& front() const;
+
+    const char& back() const;
+
+    size_t find(StringView substring) const;
+
+    size_t rfind(StringView substring) const;
+
+    // no copy, the result refers to the mapped file
+    StringView substr(size_t from, size_t count) const;
+
+    int compare(StringView other) const;
+
+    size_t hash() const;
+
+    ~MappedString();
+};
+
+void MappedString::swap(MappedString& other) {
+    std::swap(mapped_data, other.mapped_data);
+    std::swap(mapped_size, other.mapped_size);
+}
+
+MappedString::MappedString(): mapped_data(nullptr), mapped_size(0) {}
+
+MappedString::MappedString(const char* path, AccessPattern pattern): MappedString() {
+    int descriptor = open(path, O_RDONLY | O_CLOEXEC);
+    if (descriptor == -1) throw std::system_error(errno, std::generic_category(), path);
+
+    struct stat status;
+    if (fstat(descriptor, &status) == -1) {
+        int error = errno;
+        close(descriptor);
+        throw std::system_error(error, std::generic_category(), path);
+    }
+
+    if (status.st_size > 0) {
+        void* mapped = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        int error = errno;
+        // the mapping keeps its own reference to the file
+        close(descriptor);
+        if (mapped == MAP_FAILED) throw std::system_error(error, std::generic_category(), path);
+
+        mapped_data = static_cast<const char*>(mapped);
+        mapped_size = status.st_size;
+        advise(pattern);
+    } else {
+        close(descriptor);
+    }
+}
+
+MappedString::MappedString(MappedString&& source) noexcept: MappedString() {
+    swap(source);
+}
+
+MappedString& MappedString::operator=(MappedString&& source) noexcept {
+    MappedString temp = std::move(source);
+    swap(temp);
+
+    return *this;
+}
+
+// only a hint, failures are ignored
+void MappedString::advise(AccessPattern pattern) const {
+    if (mapped_data == nullptr) return;
+
+    int advice = MADV_NORMAL;
+    if (pattern == AccessPattern::SEQUENTIAL) advice = MADV_SEQUENTIAL;
+    if (pattern == AccessPattern::RANDOM) advice = MADV_RANDOM;
+    madvise(const_cast<char*>(mapped_data), mapped_size, advice);
+}
+
+MappedString::operator StringView() const {
+    return StringView(data(), size());
+}
+
+const char& MappedString::operator[](size_t index) const {
+    return data()[index];
+}
+
+const char* MappedString::data() const {
+    return mapped_data == nullptr ? &TERMINATE_SYMBOL : mapped_data;
+}
+
+size_t MappedString::size() const {
+    return mapped_size;
+}
+
+size_t MappedString::length() const {
+    return size();
+}
+
+bool MappedString::empty() const {
+    return size() == 0;
+}
+
+const char& MappedString::front() const {
+    return data()[0];
+}
+
+const char& MappedString::back() const {
+    return data()[size() - 1];
+}
+
+size_t MappedString::find(StringView substring) const {
+    return StringView(*this).find(substring);
+}
+
+size_t MappedString::rfind(StringView substring) const {
+    return StringView(*this).rfind(substring);
+}
+
+StringView MappedString::substr(size_t from, size_t count) const {
+    return StringView(*this).substr(from, count);
+}
+
+int MappedString::compare(StringView other) const {
+    return StringView(*this).compare(other);
+}
+
+size_t MappedString::hash() const {
+    return StringView(*this).hash();
+}
+
+MappedString::~MappedString() {
+    if (mapped_data != nullptr) munmap(const_cast<char*>(mapped_data), mapped_size);
+}
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "string.h"
+
+/* Searcher for huge haystacks, which scans them with several threads.
+ * The haystack is cut into blocks of start positions, every block is
+ * searched in a window extended by needle size - 1 chars, so matches
+ * crossing block borders are found exactly once. Threads take blocks
+ * one by one from a shared counter, find and rfind stop taking blocks
+ * that can't contain a better match than the one already found.
+ * */
+class ParallelSearcher {
+  private:
+    String::Searcher searcher;
+    size_t needle_size;
+    size_t thread_count;
+    size_t block_size;
+
+    // number of blocks covering all the start positions of the needle
+    size_t block_count(StringView haystack) const;
+
+    // chars where the matches starting in the block lie
+    StringView window(StringView haystack, size_t index) const;
+
+    // calls work(index) for every block until it returns false,
+    // the calling thread is one of the workers
+    template <typename Work>
+    void run(size_t count, Work work) const;
+
+    // empty needles and short haystacks are not worth the threads
+    bool is_sequential(StringView haystack) const;
+
+  public:
+    static constexpr size_t DEFAULT_BLOCK_SIZE = 1 << 20;
+
+    static size_t default_thread_count();
+
+    explicit ParallelSearcher(StringView needle, size_t thread_count=default_thread_count(),
+                              size_t block_size=DEFAULT_BLOCK_SIZE);
+
+    // same results as String::Searcher
+    size_t find_in(StringView haystack) const;
+
+    size_t rfind_in(StringView haystack) const;
+
+    std::vector<size_t> find_all(StringView haystack) const;
+
+    // find_all(haystack).size() without storing the positions
+    size_t count(StringView haystack) const;
+};
+
+size_t ParallelSearcher::default_thread_count() {
+    // hardware_concurrency is 0 when it is unknown
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+ParallelSearcher::ParallelSearcher(StringView needle, size_t thread_count, size_t block_size)
+        : searcher(needle)
+        , needle_size(needle.size())
+        , thread_count(std::max<size_t>(thread_count, 1))
+        , block_size(std::max<size_t>(block_size, 1)) {}
+
+size_t ParallelSearcher::block_count(StringView haystack) const {
+    return (haystack.size() - needle_size) / block_size + 1;
+}
+
+StringView ParallelSearcher::window(StringView haystack, size_t index) const {
+    size_t begin = index * block_size;
+    return haystack.substr(begin, std::min(block_size + needle_size - 1, haystack.size() - begin));
+}
+
+template <typename Work>
+void ParallelSearcher::run(size_t count, Work work) const {
+    std::atomic<size_t> next_block(0);
+
+    auto worker = [&next_block, count, &work]() {
+        for (size_t index = next_block.fetch_add(1, std::memory_order_relaxed); index < count;
+                index = next_block.fetch_add(1, std::memory_order_relaxed)) {
+            if (!work(index)) break;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < std::min(thread_count, count); ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+bool ParallelSearcher::is_sequential(StringView haystack) const {
+    return needle_size == 0 || needle_size > haystack.size() || thread_count == 1;
+}
+
+size_t ParallelSearcher::find_in(StringView haystack) const {
+    if (is_sequential(haystack)) return searcher.find_in(haystack);
+
+    std::atomic<size_t> result(haystack.size());
+
+    run(block_count(haystack), [&](size_t index) {
+        // blocks are taken in increasing order, the next ones start even further
+        if (index * block_size >= result.load(std::memory_order_relaxed)) return false;
+
+        StringView current = window(haystack, index);
+        size_t found = searcher.find_in(current);
+        if (found == current.size()) return true;
+
+        size_t position = index * block_size + found;
+        size_t best = result.load(std::memory_order_relaxed);
+        while (position < best && !result.compare_exchange_weak(best, position)) {}
+        return false;
+    });
+
+    return result;
+}
+
+size_t ParallelSearcher::rfind_in(StringView haystack) const {
+    if (is_sequential(haystack)) return searcher.rfind_in(haystack);
+
+    size_t count = block_count(haystack);
+    // position + 1 of the best match, 0 while nothing is found
+    std::atomic<size_t> result_end(0);
+
+    run(count, [&](size_t order) {
+        // blocks are taken from the end, the next ones end even earlier
+        size_t index = count - 1 - order;
+        if (result_end.load(std::memory_order_relaxed) > (index + 1) * block_size) return false;
+
+        StringView current = window(haystack, index);
+        size_t found = searcher.rfind_in(current);
+        if (found == current.size()) return true;
+
+        size_t position_end = index * block_size + found + 1;
+        size_t best = result_end.load(std::memory_order_relaxed);
+        while (position_end > best && !result_end.compare_exchange_weak(best, position_end)) {}
+        return false;
+    });
+
+    size_t position_end = result_end;
+    return position_end == 0 ? haystack.size() : position_end - 1;
+}
+
+std::vector<size_t> ParallelSearcher::find_all(StringView haystack) const {
+    if (is_sequential(haystack)) return searcher.find_all(haystack);
+
+    std::vector<std::vector<size_t>> block_positions(block_count(haystack));
+
+    run(block_positions.size(), [&](size_t index) {
+        block_positions[index] = searcher.find_all(window(haystack, index));
+        return true;
+    });
+
+    size_t total = 0;
+    for (const std::vector<size_t>& positions : block_positions) {
+        total += positions.size();
+    }
+
+    std::vector<size_t> result;
+    result.reserve(total);
+    for (size_t index = 0; index < block_positions.size(); ++index) {
+        for (size_t position : block_positions[index]) {
+            result.push_back(index * block_size + position);
+        }
+    }
+    return result;
+}
+
+size_t ParallelSearcher::count(StringView haystack) const {
+    if (is_sequential(haystack)) return searcher.find_all(haystack).size();
+
+    std::atomic<size_t> total(0);
+
+    run(block_count(haystack), [&](size_t index) {
+        StringView current = window(haystack, index);
+        size_t found_count = 0;
+
+        for (size_t begin = 0; ; ) {
+            StringView rest = current.substr(begin, current.size() - begin);
+            size_t found = searcher.find_in(rest);
+            if (found == rest.size()) break;
+
+            ++found_count;
+            begin += found + 1;
+        }
+
+        total.fetch_add(found_count, std::memory_order_relaxed);
+        return true;
+    });
+
+    return total;
+}
@@ -0,0 +1,467 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "string.h"
+
+/* Sequence of chars stored as String chunks in an implicit treap:
+ * in-order traversal of the nodes gives the text, every node knows
+ * the total size of its subtree. Concatenation, split, insert, erase
+ * and indexing take O(log n) expected time and never copy whole chunks
+ * except the one which is cut or takes a small insert.
+ * */
+class Rope {
+  private:
+    struct Node {
+        String chunk;
+        size_t subtree_size;
+        uint32_t priority;
+        Node* left;
+        Node* right;
+
+        Node(StringView chunk, uint32_t priority);
+    };
+
+    // long texts are cut into chunks of this size when added
+    static constexpr size_t MAX_CHUNK_SIZE = 1024;
+
+    Node* root;
+
+    // state of the xorshift generator for node priorities
+    uint32_t seed;
+
+    // every rope gets its own seed, so nodes built by different ropes and
+    // merged together don't share priorities (equal ones make merge degenerate)
+    static uint32_t next_seed();
+
+    uint32_t next_priority();
+
+    static size_t subtree_size(const Node* node);
+
+    static void update(Node* node);
+
+    static Node* merge(Node* left, Node* right);
+
+    // left gets the first position chars, right gets the rest
+    void split(Node* node, size_t position, Node*& left, Node*& right);
+
+    Node* build(StringView text);
+
+    // puts text into the chunk where position falls if it stays within
+    // MAX_CHUNK_SIZE, returns false and changes nothing otherwise
+    static bool insert_into_chunk(Node* node, size_t position, StringView text);
+
+    static Node* clone(const Node* node);
+
+    static void destroy(Node* node);
+
+    // visitor(const String& chunk) is called in text order while it returns true
+    template <typename Visitor>
+    static bool visit(const Node* node, Visitor& visitor);
+
+    template <typename Visitor>
+    static bool visit_reversed(const Node* node, Visitor& visitor);
+
+    void swap(Rope& other);
+
+  public:
+    Rope();
+
+    explicit Rope(StringView text);
+
+    Rope(const Rope& source);
+
+    Rope(Rope&& source) noexcept;
+
+    Rope& operator=(const Rope& source);
+
+    Rope& operator=(Rope&& source) noexcept;
+
+    size_t size() const;
+
+    bool empty() const;
+
+    char operator[](size_t index) const;
+
+    Rope& operator+=(StringView text);
+
+    // other is left empty
+    Rope& operator+=(Rope&& other);
+
+    // keeps [0, position) and returns [position, size())
+    Rope split(size_t position);
+
+    void insert(size_t position, StringView text);
+
+    void insert(size_t position, Rope&& other);
+
+    void erase(size_t from, size_t count);
+
+    String to_string() const;
+
+    // same contract as String::find and String::rfind,
+    // occurrences crossing chunk borders are found too
+    size_t find(StringView substring) const;
+
+    size_t rfind(StringView substring) const;
+
+    ~Rope();
+};
+
+Rope::Node::Node(StringView chunk, uint32_t priority)
+        : chunk(chunk)
+        , subtree_size(chunk.size())
+        , priority(priority)
+        , left(nullptr)
+        , right(nullptr) {}
+
+uint32_t Rope::next_seed() {
+    static std::atomic<uint32_t> rope_count(0);
+    // odd multiplier spreads consecutive counts, xorshift needs a nonzero state
+    return (rope_count.fetch_add(1, std::memory_order_relaxed) + 1) * 2654435769u | 1u;
+}
+
+uint32_t Rope::next_priority() {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+size_t Rope::subtree_size(const Node* node) {
+    return node == nullptr ? 0 : node->subtree_size;
+}
+
+void Rope::update(Node* node) {
+    node->subtree_size = subtree_size(node->left) + node->chunk.size() + subtree_size(node->right);
+}
+
+Rope::Node* Rope::merge(Node* left, Node* right) {
+    if (left == nullptr) return right;
+    if (right == nullptr) return left;
+
+    if (left->priority >= right->priority) {
+        left->right = merge(left->right, right);
+        update(left);
+        return left;
+    }
+
+    right->left = merge(left, right->left);
+    update(right);
+    return right;
+}
+
+void Rope::split(Node* node, size_t position, Node*& left, Node*& right) {
+    if (node == nullptr) {
+        left = right = nullptr;
+        return;
+    }
+
+    size_t left_size = subtree_size(node->left);
+    size_t chunk_end = left_size + node->chunk.size();
+
+    if (position <= left_size) {
+        split(node->left, position, left, node->left);
+        update(node);
+        right = node;
+    } else if (position >= chunk_end) {
+        split(node->right, position - chunk_end, node->right, right);
+        update(node);
+        left = node;
+    } else {
+        // the cut goes through this chunk, the tail becomes a separate node with
+        // the same priority, so it may stay above everything in node->right
+        size_t cut = position - left_size;
+        Node* tail = new Node(StringView(node->chunk).substr(cut, node->chunk.size() - cut),
+                              node->priority);
+        node->chunk = String(StringView(node->chunk).substr(0, cut));
+
+        tail->right = node->right;
+        node->right = nullptr;
+        update(tail);
+        update(node);
+
+        left = node;
+        right = tail;
+    }
+}
+
+Rope::Node* Rope::build(StringView text) {
+    Node* result = nullptr;
+    for (size_t from = 0; from < text.size(); from += MAX_CHUNK_SIZE) {
+        size_t count = std::min(MAX_CHUNK_SIZE, text.size() - from);
+        result = merge(result, new Node(text.substr(from, count), next_priority()));
+    }
+    return result;
+}
+
+bool Rope::insert_into_chunk(Node* node, size_t position, StringView text) {
+    if (node == nullptr) return false;
+
+    size_t left_size = subtree_size(node->left);
+    size_t chunk_end = left_size + node->chunk.size();
+    bool inserted;
+
+    // a position on a border of this chunk is taken by it
+    if (position < left_size) {
+        inserted = insert_into_chunk(node->left, position, text);
+    } else if (position > chunk_end) {
+        inserted = insert_into_chunk(node->right, position - chunk_end, text);
+    } else if (node->chunk.size() + text.size() > MAX_CHUNK_SIZE) {
+        inserted = false;
+    } else if (position == chunk_end) {
+        node->chunk += text;
+        inserted = true;
+    } else {
+        StringView chunk = node->chunk;
+        size_t cut = position - left_size;
+        node->chunk = String::concat(chunk.substr(0, cut), text, chunk.substr(cut, chunk.size() - cut));
+        inserted = true;
+    }
+
+    if (inserted) node->subtree_size += text.size();
+    return inserted;
+}
+
+Rope::Node* Rope::clone(const Node* node) {
+    if (node == nullptr) return nullptr;
+
+    Node* result = new Node(node->chunk, node->priority);
+    result->left = clone(node->left);
+    result->right = clone(node->right);
+    update(result);
+    return result;
+}
+
+void Rope::destroy(Node* node) {
+    if (node == nullptr) return;
+
+    destroy(node->left);
+    destroy(node->right);
+    delete node;
+}
+
+template <typename Visitor>
+bool Rope::visit(const Node* node, Visitor& visitor) {
+    if (node == nullptr) return true;
+
+    return visit(node->left, visitor) && visitor(node->chunk) && visit(node->right, visitor);
+}
+
+template <typename Visitor>
+bool Rope::visit_reversed(const Node* node, Visitor& visitor) {
+    if (node == nullptr) return true;
+
+    return visit_reversed(node->right, visitor) && visitor(node->chunk) &&
+           visit_reversed(node->left, visitor);
+}
+
+void Rope::swap(Rope& other) {
+    std::swap(root, other.root);
+    std::swap(seed, other.seed);
+}
+
+Rope::Rope(): root(nullptr), seed(next_seed()) {}
+
+Rope::Rope(StringView text): Rope() {
+    root = build(text);
+}
+
+Rope::Rope(const Rope& source): root(clone(source.root)), seed(next_seed()) {}
+
+Rope::Rope(Rope&& source) noexcept: Rope() {
+    swap(source);
+}
+
+Rope& Rope::operator=(const Rope& source) {
+    if (&source == this) return *this;
+
+    Rope temp = source;
+    swap(temp);
+
+    return *this;
+}
+
+Rope& Rope::operator=(Rope&& source) noexcept {
+    Rope temp = std::move(source);
+    swap(temp);
+
+    return *this;
+}
+
+size_t Rope::size() const {
+    return subtree_size(root);
+}
+
+bool Rope::empty() const {
+    return size() == 0;
+}
+
+char Rope::operator[](size_t index) const {
+    const Node* node = root;
+    while (true) {
+        size_t left_size = subtree_size(node->left);
+        if (index < left_size) {
+            node = node->left;
+        } else if (index < left_size + node->chunk.size()) {
+            return node->chunk[index - left_size];
+        } else {
+            index -= left_size + node->chunk.size();
+            node = node->right;
+        }
+    }
+}
+
+Rope& Rope::operator+=(StringView text) {
+    root = merge(root, build(text));
+    return *this;
+}
+
+Rope& Rope::operator+=(Rope&& other) {
+    root = merge(root, other.root);
+    other.root = nullptr;
+    return *this;
+}
+
+Rope Rope::split(size_t position) {
+    Rope result;
+    split(root, position, root, result.root);
+    return result;
+}
+
+// small texts join a neighbouring chunk, so many small edits don't make a
+// node per edit; the new nodes take priorities from this rope's generator
+void Rope::insert(size_t position, StringView text) {
+    if (insert_into_chunk(root, position, text)) return;
+
+    Node* left;
+    Node* right;
+    split(root, position, left, right);
+
+    root = merge(merge(left, build(text)), right);
+}
+
+void Rope::insert(size_t position, Rope&& other) {
+    Node* left;
+    Node* right;
+    split(root, position, left, right);
+
+    root = merge(merge(left, other.root), right);
+    other.root = nullptr;
+}
+
+void Rope::erase(size_t from, size_t count) {
+    Node* left;
+    Node* middle;
+    Node* right;
+    split(root, from, left, right);
+    split(right, count, middle, right);
+
+    destroy(middle);
+    root = merge(left, right);
+}
+
+String Rope::to_string() const {
+    String result(size());
+    char* current = result.data();
+
+    auto copy_chunk = [&current](const String& chunk) {
+        current = std::copy(chunk.data(), chunk.data() + chunk.size(), current);
+        return true;
+    };
+    visit(root, copy_chunk);
+
+    return result;
+}
+
+/* Every chunk is searched on its own. Occurrences which cross chunk
+ * borders start in the last substring.size() - 1 chars seen before the
+ * chunk, so these chars are kept in carry and searched together with
+ * the head of the chunk.
+ * */
+size_t Rope::find(StringView substring) const {
+    if (substring.empty()) return 0;
+
+    size_t border_size = substring.size() - 1;
+    size_t chunk_begin = 0;
+    size_t result = size();
+    String carry;
+
+    auto search_chunk = [&](const String& chunk) {
+        String window = carry;
+        window += StringView(chunk).substr(0, std::min(border_size, chunk.size()));
+
+        size_t found = window.find(substring);
+        if (found < carry.size()) {
+            result = chunk_begin - carry.size() + found;
+            return false;
+        }
+
+        found = chunk.find(substring);
+        if (found != chunk.size()) {
+            result = chunk_begin + found;
+            return false;
+        }
+
+        // carry becomes the last border_size chars of carry + chunk
+        if (chunk.size() >= border_size) {
+            carry = String(StringView(chunk).substr(chunk.size() - border_size, border_size));
+        } else {
+            carry += chunk;
+            size_t kept = std::min(carry.size(), border_size);
+            carry = String(StringView(carry).substr(carry.size() - kept, kept));
+        }
+        chunk_begin += chunk.size();
+        return true;
+    };
+    visit(root, search_chunk);
+
+    return result;
+}
+
+// mirrored find: carry keeps the first substring.size() - 1 chars after the chunk
+size_t Rope::rfind(StringView substring) const {
+    if (substring.empty()) return size();
+
+    size_t border_size = substring.size() - 1;
+    size_t chunk_end = size();
+    size_t result = size();
+    String carry;
+
+    auto search_chunk = [&](const String& chunk) {
+        size_t tail_size = std::min(border_size, chunk.size());
+        String window(StringView(chunk).substr(chunk.size() - tail_size, tail_size));
+        window += carry;
+
+        size_t found = window.rfind(substring);
+        if (found < tail_size) {
+            result = chunk_end - tail_size + found;
+            return false;
+        }
+
+        found = chunk.rfind(substring);
+        if (found != chunk.size()) {
+            result = chunk_end - chunk.size() + found;
+            return false;
+        }
+
+        // carry becomes the first border_size chars of chunk + carry
+        if (chunk.size() >= border_size) {
+            carry = String(StringView(chunk).substr(0, border_size));
+        } else {
+            String head = chunk;
+            head += carry;
+            carry = String(StringView(head).substr(0, std::min(head.size(), border_size)));
+        }
+        chunk_end -= chunk.size();
+        return true;
+    };
+    visit_reversed(root, search_chunk);
+
+    return result;
+}
+
+Rope::~Rope() {
+    destroy(root);
+}
@@ -0,0 +1,326 @@
+#pragma once
+
+#include <atomic>
+#include <new>
+
+#include "string.h"
+
+/* Copy-on-write string: copies share one reference counted buffer, the
+ * buffer is copied only when a shared string is changed. The counter is
+ * atomic, so copies of one string can be read and copied in different
+ * threads, but a single SharedString object is not meant to be changed
+ * concurrently (the same rule as for String).
+ *
+ * A reference or a pointer obtained from a non-const member is valid
+ * only until the string is copied: writing through it afterwards
+ * would change the copy too.
+ * */
+class SharedString {
+  private:
+    struct Buffer {
+        std::atomic<size_t> references;
+        size_t capacity;
+
+        explicit Buffer(size_t capacity);
+
+        // chars are stored right after the header
+        char* chars();
+    };
+
+    // nullptr for strings which never had any data
+    Buffer* buffer;
+    size_t data_size;
+
+    static Buffer* allocate(size_t capacity);
+
+    // decreases the counter and frees the buffer after the last owner
+    static void release(Buffer* buffer);
+
+    bool is_unique() const;
+
+    /* Makes the buffer owned by this string only and able to keep
+     * capacity chars. Returns the previous buffer if it was replaced,
+     * the caller releases it when its data is no longer needed.
+     * */
+    Buffer* detach(size_t capacity);
+
+    void swap(SharedString& other);
+
+  public:
+    SharedString();
+
+    SharedString(const char* source);
+
+    explicit SharedString(StringView source);
+
+    SharedString(const SharedString& source);
+
+    SharedString(SharedString&& source) noexcept;
+
+    SharedString& operator=(const SharedString& source);
+
+    SharedString& operator=(SharedString&& source) noexcept;
+
+    operator StringView() const;
+
+    size_t size() const;
+
+    size_t length() const;
+
+    bool empty() const;
+
+    size_t capacity() const;
+
+    // number of strings sharing the buffer
+    size_t use_count() const;
+
+    const char* data() const;
+
+    char* data();
+
+    const char& operator[](size_t index) const;
+
+    char& operator[](size_t index);
+
+    const char& front() const;
+
+    char& front();
+
+    const char& back() const;
+
+    char& back();
+
+    void push_back(char c);
+
+    void pop_back();
+
+    SharedString& operator+=(StringView other);
+
+    SharedString& operator+=(char c);
+
+    void clear();
+
+    size_t find(StringView substring) const;
+
+    size_t rfind(StringView substring) const;
+
+    int compare(StringView other) const;
+
+    size_t hash() const;
+
+    String to_string() const;
+
+    ~SharedString();
+};
+
+SharedString::Buffer::Buffer(size_t capacity): references(1), capacity(capacity) {}
+
+char* SharedString::Buffer::chars() {
+    return reinterpret_cast<char*>(this + 1);
+}
+
+SharedString::Buffer* SharedString::allocate(size_t capacity) {
+    // one more byte for terminate character at the end
+    char* memory = new char[sizeof(Buffer) + capacity + 1];
+    return new (memory) Buffer(capacity);
+}
+
+void SharedString::release(Buffer* buffer) {
+    if (buffer == nullptr) return;
+
+    // acq_rel: the last owner must see all writes of the others before freeing
+    if (buffer->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        buffer->~Buffer();
+        delete[] reinterpret_cast<char*>(buffer);
+    }
+}
+
+bool SharedString::is_unique() const {
+    return buffer != nullptr && buffer->references.load(std::memory_order_acquire) == 1;
+}
+
+SharedString::Buffer* SharedString::detach(size_t capacity) {
+    if (is_unique() && buffer->capacity >= capacity) return nullptr;
+
+    if (buffer != nullptr && capacity > buffer->capacity) {
+        // to have O(1) amortized complexity of appends grow at least twice
+        capacity = std::max(capacity, buffer->capacity * 2);
+    }
+
+    Buffer* previous = buffer;
+    buffer = allocate(capacity);
+    if (previous != nullptr) {
+        std::copy(previous->chars(), previous->chars() + data_size, buffer->chars());
+    }
+    buffer->chars()[data_size] = TERMINATE_SYMBOL;
+    return previous;
+}
+
+void SharedString::swap(SharedString& other) {
+    std::swap(buffer, other.buffer);
+    std::swap(data_size, other.data_size);
+}
+
+SharedString::SharedString(): buffer(nullptr), data_size(0) {}
+
+SharedString::SharedString(const char* source): SharedString(StringView(source)) {}
+
+SharedString::SharedString(StringView source): buffer(nullptr), data_size(0) {
+    if (source.empty()) return;
+
+    buffer = allocate(source.size());
+    data_size = source.size();
+    std::copy(source.data(), source.data() + data_size, buffer->chars());
+    buffer->chars()[data_size] = TERMINATE_SYMBOL;
+}
+
+SharedString::SharedString(const SharedString& source)
+        : buffer(source.buffer)
+        , data_size(source.data_size) {
+
+    // relaxed: a new owner is added by an existing one, nothing to synchronize
+    if (buffer != nullptr) buffer->references.fetch_add(1, std::memory_order_relaxed);
+}
+
+SharedString::SharedString(SharedString&& source) noexcept: SharedString() {
+    swap(source);
+}
+
+SharedString& SharedString::operator=(const SharedString& source) {
+    SharedString temp = source;
+    swap(temp);
+
+    return *this;
+}
+
+SharedString& SharedString::operator=(SharedString&& source) noexcept {
+    SharedString temp = std::move(source);
+    swap(temp);
+
+    return *this;
+}
+
+SharedString::operator StringView() const {
+    return StringView(data(), size());
+}
+
+size_t SharedString::size() const {
+    return data_size;
+}
+
+size_t SharedString::length() const {
+    return size();
+}
+
+bool SharedString::empty() const {
+    return size() == 0;
+}
+
+size_t SharedString::capacity() const {
+    return buffer == nullptr ? 0 : buffer->capacity;
+}
+
+size_t SharedString::use_count() const {
+    return buffer == nullptr ? 0 : buffer->references.load(std::memory_order_relaxed);
+}
+
+const char* SharedString::data() const {
+    // selected without a branch like String::data(), a branch would be
+    // duplicated into the callers, and GCC warns about indexing the
+    // TERMINATE_SYMBOL copy with the indices of non-empty strings
+    uintptr_t empty_mask = static_cast<uintptr_t>(0) - (buffer == nullptr);
+    uintptr_t chars = reinterpret_cast<uintptr_t>(buffer) + sizeof(Buffer);
+    return reinterpret_cast<const char*>((chars & ~empty_mask)
+            | (reinterpret_cast<uintptr_t>(&TERMINATE_SYMBOL) & empty_mask));
+}
+
+char* SharedString::data() {
+    release(detach(data_size));
+    return buffer->chars();
+}
+
+const char& SharedString::operator[](size_t index) const {
+    return data()[index];
+}
+
+char& SharedString::operator[](size_t index) {
+    return data()[index];
+}
+
+const char& SharedString::front() const {
+    return data()[0];
+}
+
+char& SharedString::front() {
+    return data()[0];
+}
+
+const char& SharedString::back() const {
+    return data()[size() - 1];
+}
+
+char& SharedString::back() {
+    return data()[size() - 1];
+}
+
+void SharedString::push_back(char c) {
+    *this += c;
+}
+
+void SharedString::pop_back() {
+    char* chars = data();
+    --data_size;
+    chars[data_size] = TERMINATE_SYMBOL;
+}
+
+SharedString& SharedString::operator+=(StringView other) {
+    // other may point into the previous buffer, so it is released after copying
+    Buffer* previous = detach(data_size + other.size());
+
+    std::copy(other.data(), other.data() + other.size(), buffer->chars() + data_size);
+    data_size += other.size();
+    buffer->chars()[data_size] = TERMINATE_SYMBOL;
+
+    release(previous);
+    return *this;
+}
+
+SharedString& SharedString::operator+=(char c) {
+    return *this += StringView(&c, 1);
+}
+
+void SharedString::clear() {
+    // the shared buffer stays with the other owners
+    if (!is_unique()) {
+        SharedString temp;
+        swap(temp);
+        return;
+    }
+
+    data_size = 0;
+    buffer->chars()[0] = TERMINATE_SYMBOL;
+}
+
+size_t SharedString::find(StringView substring) const {
+    return StringView(*this).find(substring);
+}
+
+size_t SharedString::rfind(StringView substring) const {
+    return StringView(*this).rfind(substring);
+}
+
+int SharedString::compare(StringView other) const {
+    return StringView(*this).compare(other);
+}
+
+size_t SharedString::hash() const {
+    return StringView(*this).hash();
+}
+
+String SharedString::to_string() const {
+    return String(StringView(*this));
+}
+
+SharedString::~SharedString() {
+    release(buffer);
+}
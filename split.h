@@ -0,0 +1,237 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <vector>
+
+#include "string.h"
+
+/* Lazy range of the pieces of a text between delimiters. Pieces are
+ * views into the text, nothing is copied or allocated, so the text
+ * must outlive the range and the views taken from it.
+ * Made by split, split_any and split_whitespace below.
+ * */
+class SplitRange {
+  public:
+    enum class Mode {
+        // a single delimiter char
+        CHAR,
+        // delimiters is a separator, an empty one never matches
+        SEPARATOR,
+        // every char of delimiters is a delimiter
+        CHAR_SET,
+        // like CHAR_SET, but empty pieces are skipped,
+        // so runs of delimiters work as one like in operator>>
+        SKIP_EMPTY
+    };
+
+    class Iterator;
+
+  private:
+    StringView text;
+    // CHAR mode keeps the delimiter by value, a view of an
+    // argument would dangle after the range is returned
+    char delimiter;
+    StringView delimiters;
+    Mode mode;
+
+    // position of the next delimiter at or after from, text.size() if there is none
+    size_t find_delimiter(size_t from) const;
+
+    size_t delimiter_size() const;
+
+    // the range refers to delimiters, they must outlive it.
+    // Only the factories below make ranges, so the mode always fits the arguments
+    SplitRange(StringView text, StringView delimiters, Mode mode);
+
+    SplitRange(StringView text, char delimiter);
+
+    friend SplitRange split(StringView text, char delimiter);
+
+    friend SplitRange split(StringView text, StringView separator);
+
+    friend SplitRange split_any(StringView text, StringView chars);
+
+    friend SplitRange split_whitespace(StringView text);
+
+  public:
+    Iterator begin() const;
+
+    Iterator end() const;
+
+    // number of pieces, the text is scanned to count them
+    size_t count() const;
+
+    // appends the pieces to pieces, its memory is reserved once
+    void split_into(std::vector<StringView>& pieces) const;
+};
+
+class SplitRange::Iterator {
+  private:
+    // the range must outlive its iterators
+    const SplitRange* range;
+    StringView piece;
+    // start of the next piece, text.size() + 1 when the current piece
+    // is the last one and text.size() + 2 for the end iterator
+    size_t next_begin;
+
+    // the piece starting at next_begin becomes the current one
+    void advance();
+
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = StringView;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const StringView*;
+    using reference = const StringView&;
+
+    Iterator(const SplitRange* range, size_t next_begin);
+
+    const StringView& operator*() const;
+
+    const StringView* operator->() const;
+
+    Iterator& operator++();
+
+    Iterator operator++(int);
+
+    // iterators of the same range only
+    bool operator==(const Iterator& other) const;
+
+    bool operator!=(const Iterator& other) const;
+};
+
+// n delimiters give n + 1 pieces, so empty text gives one empty piece
+SplitRange split(StringView text, char delimiter);
+
+// an empty separator gives the whole text as one piece
+SplitRange split(StringView text, StringView separator);
+
+// every char of chars is a delimiter
+SplitRange split_any(StringView text, StringView chars);
+
+// words between runs of the "C" locale whitespaces, like operator>> reads them
+SplitRange split_whitespace(StringView text);
+
+const char WHITESPACE_CHARS[] = " \t\n\v\f\r";
+
+SplitRange::SplitRange(StringView text, StringView delimiters, Mode mode)
+        : text(text)
+        , delimiter(TERMINATE_SYMBOL)
+        , delimiters(delimiters)
+        , mode(mode) {}
+
+SplitRange::SplitRange(StringView text, char delimiter)
+        : text(text)
+        , delimiter(delimiter)
+        , mode(Mode::CHAR) {}
+
+size_t SplitRange::find_delimiter(size_t from) const {
+    StringView rest = text.substr(from, text.size() - from);
+
+    // a single char is found with memchr, separators and sets with the SIMD kernels
+    size_t found;
+    if (mode == Mode::CHAR) {
+        found = rest.find(StringView(&delimiter, 1));
+    } else if (mode == Mode::SEPARATOR) {
+        // an empty one would match in place and never move the pieces on
+        found = delimiters.empty() ? rest.size() : rest.find(delimiters);
+    } else {
+        found = rest.find_first_of(delimiters);
+    }
+    return from + found;
+}
+
+size_t SplitRange::delimiter_size() const {
+    return mode == Mode::SEPARATOR ? delimiters.size() : 1;
+}
+
+SplitRange::Iterator SplitRange::begin() const {
+    return Iterator(this, 0);
+}
+
+SplitRange::Iterator SplitRange::end() const {
+    return Iterator(this, text.size() + 2);
+}
+
+size_t SplitRange::count() const {
+    size_t result = 0;
+    for (Iterator current = begin(); current != end(); ++current) {
+        ++result;
+    }
+    return result;
+}
+
+void SplitRange::split_into(std::vector<StringView>& pieces) const {
+    pieces.reserve(pieces.size() + count());
+    for (StringView piece : *this) {
+        pieces.push_back(piece);
+    }
+}
+
+SplitRange::Iterator::Iterator(const SplitRange* range, size_t next_begin)
+        : range(range)
+        , next_begin(next_begin) {
+
+    advance();
+}
+
+void SplitRange::Iterator::advance() {
+    const StringView& text = range->text;
+
+    while (next_begin <= text.size()) {
+        size_t piece_begin = next_begin;
+        size_t piece_end = range->find_delimiter(piece_begin);
+
+        piece = text.substr(piece_begin, piece_end - piece_begin);
+        next_begin = piece_end == text.size() ? text.size() + 1 : piece_end + range->delimiter_size();
+
+        if (!piece.empty() || range->mode != Mode::SKIP_EMPTY) return;
+    }
+    // past the last piece all the iterators are equal to end()
+    next_begin = text.size() + 2;
+    piece = StringView();
+}
+
+const StringView& SplitRange::Iterator::operator*() const {
+    return piece;
+}
+
+const StringView* SplitRange::Iterator::operator->() const {
+    return &piece;
+}
+
+SplitRange::Iterator& SplitRange::Iterator::operator++() {
+    advance();
+    return *this;
+}
+
+SplitRange::Iterator SplitRange::Iterator::operator++(int) {
+    Iterator result = *this;
+    advance();
+    return result;
+}
+
+bool SplitRange::Iterator::operator==(const Iterator& other) const {
+    return next_begin == other.next_begin;
+}
+
+bool SplitRange::Iterator::operator!=(const Iterator& other) const {
+    return !(*this == other);
+}
+
+SplitRange split(StringView text, char delimiter) {
+    return SplitRange(text, delimiter);
+}
+
+SplitRange split(StringView text, StringView separator) {
+    return SplitRange(text, separator, SplitRange::Mode::SEPARATOR);
+}
+
+SplitRange split_any(StringView text, StringView chars) {
+    return SplitRange(text, chars, SplitRange::Mode::CHAR_SET);
+}
+
+SplitRange split_whitespace(StringView text) {
+    return SplitRange(text, WHITESPACE_CHARS, SplitRange::Mode::SKIP_EMPTY);
+}
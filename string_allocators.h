@@ -0,0 +1,147 @@
+#pragma once
+
+#include <vector>
+
+#include "string.h"
+
+// Allocators below are not thread safe: use one per thread or per request.
+// After reset() every string which took a buffer from the allocator
+// must be destroyed or cleared with shrink_to_fit, otherwise it is UB
+
+// Bump pointer allocator: allocation is a pointer increment, memory comes
+// back only on reset(), which keeps the blocks for the next request
+class ArenaStringAllocator: public StringAllocator {
+  private:
+    struct Block {
+        char* begin;
+        size_t size;
+    };
+
+    size_t block_size;
+    std::vector<Block> blocks;
+
+    // allocations are served from blocks[current_block] starting at offset
+    size_t current_block;
+    size_t offset;
+
+    char* last_allocation;
+
+  public:
+    static constexpr size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+    explicit ArenaStringAllocator(size_t block_size=DEFAULT_BLOCK_SIZE);
+
+    ArenaStringAllocator(const ArenaStringAllocator&) = delete;
+
+    ArenaStringAllocator& operator=(const ArenaStringAllocator&) = delete;
+
+    char* allocate(size_t size) override;
+
+    // only the latest allocation is given back, it is the one a growing string releases
+    void deallocate(char* buffer, size_t size) override;
+
+    void reset();
+
+    // total size of the blocks taken from the heap
+    size_t reserved() const;
+
+    ~ArenaStringAllocator();
+};
+
+// Power of two size classes with free lists, sizes above MAX_CLASS_SIZE
+// go directly to new[] and delete[]
+class PoolStringAllocator: public StringAllocator {
+  private:
+    SizeClassFreeLists free_lists;
+
+    // fresh buffers are carved from chunks, which live until destruction
+    ArenaStringAllocator chunks;
+
+  public:
+    static constexpr size_t MAX_CLASS_SIZE = SizeClassFreeLists::MAX_CLASS_SIZE;
+
+    explicit PoolStringAllocator(size_t chunk_size=ArenaStringAllocator::DEFAULT_BLOCK_SIZE);
+
+    char* allocate(size_t size) override;
+
+    void deallocate(char* buffer, size_t size) override;
+
+    void reset();
+};
+
+ArenaStringAllocator::ArenaStringAllocator(size_t block_size)
+        : block_size(block_size)
+        , current_block(0)
+        , offset(0)
+        , last_allocation(nullptr) {}
+
+char* ArenaStringAllocator::allocate(size_t size) {
+    while (current_block < blocks.size() && blocks[current_block].size - offset < size) {
+        ++current_block;
+        offset = 0;
+    }
+
+    if (current_block == blocks.size()) {
+        Block block = {new char[std::max(size, block_size)], std::max(size, block_size)};
+        blocks.push_back(block);
+        offset = 0;
+    }
+
+    last_allocation = blocks[current_block].begin + offset;
+    offset += size;
+    return last_allocation;
+}
+
+void ArenaStringAllocator::deallocate(char* buffer, size_t size) {
+    if (buffer == last_allocation && offset >= size) {
+        offset -= size;
+        last_allocation = nullptr;
+    }
+}
+
+void ArenaStringAllocator::reset() {
+    current_block = 0;
+    offset = 0;
+    last_allocation = nullptr;
+}
+
+size_t ArenaStringAllocator::reserved() const {
+    size_t result = 0;
+    for (const Block& block : blocks) {
+        result += block.size;
+    }
+    return result;
+}
+
+ArenaStringAllocator::~ArenaStringAllocator() {
+    for (const Block& block : blocks) {
+        delete[] block.begin;
+    }
+}
+
+PoolStringAllocator::PoolStringAllocator(size_t chunk_size): chunks(chunk_size) {}
+
+char* PoolStringAllocator::allocate(size_t size) {
+    if (size > MAX_CLASS_SIZE) return new char[size];
+
+    char* buffer = free_lists.pop(size);
+    if (buffer == nullptr) {
+        return chunks.allocate(SizeClassFreeLists::class_size(size));
+    }
+    return buffer;
+}
+
+void PoolStringAllocator::deallocate(char* buffer, size_t size) {
+    if (size > MAX_CLASS_SIZE) {
+        delete[] buffer;
+        return;
+    }
+
+    free_lists.push(buffer, size);
+}
+
+void PoolStringAllocator::reset() {
+    // the free buffers belong to the chunks, which are reused as a whole
+    free_lists = SizeClassFreeLists();
+    chunks.reset();
+}
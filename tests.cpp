@@ -1,8 +1,19 @@
+#include <fstream>
 #include <iostream>
 #include <gtest/gtest.h>
 #include <new>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include "string.h"
+#include "aho_corasick.h"
+#include "intern_pool.h"
+#include "mapped_string.h"
+#include "parallel_find.h"
+#include "rope.h"
+#include "shared_string.h"
+#include "split.h"
+#include "string_allocators.h"
 
 int new_count = 0;
 
@@ -13,6 +24,12 @@ void* operator new[](size_t size) {
     return p;
 }
 
+#ifdef STRING_BUFFER_POOL
+// tests counting new[] calls expect every heap buffer to come from new[],
+// so the pool of the main thread keeps nothing unless a test asks for it
+const bool POOL_DISABLED = (StringBufferPool::local()->set_max_retained_bytes(0), true);
+#endif
+
 void check_last_symbol(const String& s) {
     ASSERT_EQ('\0', s.data()[s.size()]);
 }
@@ -158,6 +175,26 @@ TEST(OperatorTests, ComparisonSizeMore) {
     ASSERT_TRUE(s1 >= s2);
 }
 
+TEST(OperatorTests, ComparisonHighBytes) {
+    String s1 = "a", s2 = "a";
+    s2[0] = static_cast<char>(200);
+
+    ASSERT_TRUE(s1 < s2);
+    ASSERT_TRUE(s2 > s1);
+}
+
+TEST(MethodTests, Compare) {
+    String s = "abcd";
+
+    ASSERT_EQ(0, s.compare("abcd"));
+    ASSERT_LT(s.compare("abce"), 0);
+    ASSERT_GT(s.compare("abcc"), 0);
+    ASSERT_LT(s.compare("abcde"), 0);
+    ASSERT_GT(s.compare("abc"), 0);
+    ASSERT_GT(s.compare(""), 0);
+    ASSERT_EQ(0, String().compare(""));
+}
+
 TEST(OperatorTests, BracketsConst) {
     const char* value = "abcd";
     const String s(value);
@@ -463,12 +500,45 @@ TEST(MethodTests, RFindEmpty) {
     ASSERT_EQ(4, s.rfind(String()));
 }
 
+TEST(MethodTests, FindLongNeedle) {
+    String needle(40, 'a');
+    needle += 'b';
+    String s(100, 'a');
+    s += needle;
+    s += String(100, 'a');
+
+    ASSERT_EQ(100, s.find(needle));
+    ASSERT_EQ(100, s.rfind(needle));
+    ASSERT_EQ(s.size(), s.find(String(300, 'a')));
+}
+
+TEST(MethodTests, FindMatchesStdString) {
+    std::string haystack;
+    for (size_t i = 0; i < 500; ++i) {
+        // pseudo random text over a small alphabet has many partial matches
+        haystack.push_back('a' + (i * 7 + i / 13) % 3);
+    }
+    String s(haystack.c_str());
+
+    for (size_t begin = 0; begin < haystack.size(); begin += 37) {
+        for (size_t length = 1; length <= 70 && begin + length <= haystack.size(); length += 3) {
+            std::string needle = haystack.substr(begin, length);
+            ASSERT_EQ(haystack.find(needle), s.find(needle.c_str()));
+            ASSERT_EQ(haystack.rfind(needle), s.rfind(needle.c_str()));
+        }
+    }
+
+    std::string missing(5, 'd');
+    ASSERT_EQ(s.size(), s.find(missing.c_str()));
+    ASSERT_EQ(s.size(), s.rfind(missing.c_str()));
+}
+
 TEST(MethodTests, Substr) {
     String s = "test";
    
     new_count = 0; 
     auto result = s.substr(1, 2);
-    ASSERT_EQ(1, new_count);
+    ASSERT_EQ(0, new_count);
     ASSERT_EQ("es", result);
     check_last_symbol(result);
 }
@@ -478,7 +548,7 @@ TEST(MethodTests, SubstrEmpty) {
 
     new_count = 0;
     auto result = s.substr(1, 0);
-    ASSERT_EQ(1, new_count);
+    ASSERT_EQ(0, new_count);
     ASSERT_EQ(String(), result);
     check_last_symbol(result);
 }
@@ -490,7 +560,7 @@ TEST(MethodTests, SubstrEmptyOnEmpty) {
     
     new_count = 0;
     auto result = s.substr(0, 0);
-    ASSERT_EQ(1, new_count);
+    ASSERT_EQ(0, new_count);
     ASSERT_EQ(String(), result);
     check_last_symbol(result);
 }
@@ -501,6 +571,67 @@ TEST(MethodTests, SubstrEmptyOnEmptyNotZero) {
     ASSERT_NO_THROW(s.substr(1, 0));
 }
 
+TEST(MethodTests, HashEqualStrings) {
+    for (size_t size = 0; size < 100; size += 7) {
+        String s1(size, 'x'), s2(size, 'x');
+        ASSERT_EQ(s1.hash(), s2.hash());
+        ASSERT_EQ(std::hash<String>()(s1), s1.hash());
+    }
+    ASSERT_NE(String("abc").hash(), String("abd").hash());
+    ASSERT_NE(String(40, 'a').hash(), String(41, 'a').hash());
+}
+
+TEST(MethodTests, HashAfterChange) {
+    String s(50, 'a');
+    size_t before = s.hash();
+
+    s[10] = 'b';
+    ASSERT_NE(before, s.hash());
+    s[10] = 'a';
+    ASSERT_EQ(before, s.hash());
+
+    s.push_back('c');
+    ASSERT_EQ((String(50, 'a') + 'c').hash(), s.hash());
+    s.pop_back();
+    ASSERT_EQ(before, s.hash());
+    s += "de";
+    s.clear();
+    ASSERT_EQ(String().hash(), s.hash());
+}
+
+TEST(MethodTests, HashConcurrentReaders) {
+    const String key(100, 'k');
+    size_t expected = String(100, 'k').hash();
+    std::vector<std::thread> workers;
+
+    for (size_t i = 0; i < 4; ++i) {
+        workers.emplace_back([&key, expected]() {
+            for (size_t j = 0; j < 1000; ++j) {
+                if (std::hash<String>()(key) != expected) abort();
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    // a copy of a hashed string keeps the hash
+    String copy = key;
+    ASSERT_EQ(expected, copy.hash());
+}
+
+TEST(MethodTests, HashAsMapKey) {
+    std::unordered_map<String, int> table;
+    table["one"] = 1;
+    table["two"] = 2;
+    table[String(30, 'x')] = 30;
+
+    ASSERT_EQ(1, table.at("one"));
+    ASSERT_EQ(2, table.at("two"));
+    ASSERT_EQ(30, table.at(String(30, 'x')));
+    ASSERT_EQ(0, table.count("three"));
+}
+
 TEST(MethodTests, EmptyFalse) {
     String s = "test";
 
@@ -614,6 +745,130 @@ TEST(MethodTests, CapacityExtended) {
     ASSERT_TRUE(s.size() < s.capacity());
 }
 
+TEST(MethodTests, Reserve) {
+    String s = "test";
+    s.reserve(100);
+
+    ASSERT_EQ(100, s.capacity());
+    ASSERT_EQ("test", s);
+    check_last_symbol(s);
+
+    new_count = 0;
+    for (size_t i = 4; i < 100; ++i) {
+        s += 'a';
+    }
+    ASSERT_EQ(0, new_count);
+
+    s.reserve(10);
+    ASSERT_EQ(100, s.capacity());
+}
+
+TEST(MethodTests, Resize) {
+    String s = "test";
+    s.resize(7, 'x');
+
+    ASSERT_EQ("testxxx", s);
+    check_last_symbol(s);
+
+    s.resize(2);
+    ASSERT_EQ("te", s);
+    check_last_symbol(s);
+
+    s.resize(100, 'y');
+    ASSERT_EQ(100, s.size());
+    ASSERT_EQ('y', s.back());
+    ASSERT_EQ('e', s[1]);
+    check_last_symbol(s);
+}
+
+TEST(MethodTests, ResizeAndOverwrite) {
+    String s = "test";
+    s.resize_and_overwrite(100, [](char* chars, size_t size) {
+        EXPECT_EQ(100, size);
+        EXPECT_EQ('t', chars[0]);
+        memcpy(chars + 4, "ing", 3);
+        return 7;
+    });
+
+    ASSERT_EQ("testing", s);
+    ASSERT_TRUE(s.capacity() >= 100);
+    check_last_symbol(s);
+
+    s.resize_and_overwrite(2, [](char*, size_t size) {
+        return size;
+    });
+    ASSERT_EQ("te", s);
+    check_last_symbol(s);
+}
+
+TEST(OperatorTests, PlusAllocatesOnce) {
+    String left(100, 'a'), right(100, 'b');
+
+    new_count = 0;
+    String result = left + right;
+    ASSERT_EQ(1, new_count);
+    ASSERT_EQ(200, result.size());
+    ASSERT_EQ('a', result[99]);
+    ASSERT_EQ('b', result[100]);
+    check_last_symbol(result);
+}
+
+TEST(MethodTests, Concat) {
+    String key(30, 'k');
+    StringView value = "value";
+
+    new_count = 0;
+    String line = String::concat("prefix.", key, ':', value, '\n');
+    ASSERT_EQ(1, new_count);
+
+    String expected = "prefix.";
+    expected += key;
+    expected += ':';
+    expected += value;
+    expected += '\n';
+    ASSERT_EQ(expected, line);
+    check_last_symbol(line);
+
+    ASSERT_EQ(String(), String::concat());
+    ASSERT_EQ("a", String::concat('a'));
+}
+
+TEST(MethodTests, Append) {
+    String s = "abc";
+    s.append(s, '-', "xyz", s);
+
+    ASSERT_EQ("abcabc-xyzabc", s);
+    check_last_symbol(s);
+
+    s.reserve(100);
+    new_count = 0;
+    s.append(StringView(s).substr(0, 3), '!');
+    ASSERT_EQ(0, new_count);
+    ASSERT_EQ("abcabc-xyzabcabc!", s);
+    check_last_symbol(s);
+}
+
+TEST(MethodTests, CopyFitsExactly) {
+    String s(100, 'a');
+    s.reserve(1000);
+
+    String copy = s;
+    ASSERT_EQ(100, copy.capacity());
+    ASSERT_EQ(s, copy);
+    check_last_symbol(copy);
+}
+
+TEST(MethodTests, AppendGrowsGeometrically) {
+    String s(100, 'a');
+
+    new_count = 0;
+    for (size_t i = 0; i < 10000; ++i) {
+        s += 'a';
+    }
+    ASSERT_TRUE(new_count < 20);
+    ASSERT_TRUE(s.size() <= s.capacity());
+}
+
 TEST(IOTests, InputOneWord) {
     std::stringstream simulation;
     const char* text = "test";
@@ -637,6 +892,69 @@ TEST(IOTests, InputTwoWords) {
     check_last_symbol(s2);
 }
 
+TEST(IOTests, InputLongWord) {
+    std::stringstream simulation;
+    std::string word(1000, 'w');
+    simulation << word << " next";
+    String s1, s2;
+    simulation >> s1 >> s2;
+
+    ASSERT_EQ(String(word.c_str()), s1);
+    ASSERT_EQ("next", s2);
+    check_last_symbol(s1);
+}
+
+TEST(IOTests, InputStreamState) {
+    std::stringstream simulation;
+    simulation << "word ";
+    String s;
+
+    simulation >> s;
+    ASSERT_TRUE(simulation.good());
+    simulation >> s;
+    ASSERT_TRUE(s.empty());
+    ASSERT_TRUE(simulation.eof());
+    ASSERT_TRUE(simulation.fail());
+}
+
+TEST(IOTests, Getline) {
+    std::stringstream simulation;
+    simulation << "first line\n\nthird line";
+    String s;
+
+    ASSERT_TRUE(getline(simulation, s));
+    ASSERT_EQ("first line", s);
+    ASSERT_TRUE(getline(simulation, s));
+    ASSERT_EQ("", s);
+    ASSERT_TRUE(getline(simulation, s));
+    ASSERT_EQ("third line", s);
+    ASSERT_TRUE(simulation.eof());
+    check_last_symbol(s);
+
+    ASSERT_FALSE(getline(simulation, s));
+    ASSERT_TRUE(s.empty());
+}
+
+TEST(IOTests, GetlineDelimiter) {
+    std::stringstream simulation;
+    simulation << "a,bc,";
+    String s;
+
+    getline(simulation, s, ',');
+    ASSERT_EQ("a", s);
+    getline(simulation, s, ',');
+    ASSERT_EQ("bc", s);
+    ASSERT_FALSE(getline(simulation, s, ','));
+}
+
+TEST(OperatorTests, PlusEqSelfView) {
+    String s = "abcdefghijklmnopqrstuvwxyz";
+    s += StringView(s).substr(20, 6);
+
+    ASSERT_EQ("abcdefghijklmnopqrstuvwxyzuvwxyz", s);
+    check_last_symbol(s);
+}
+
 TEST(IOTests, Output) {
     std::stringstream simulation;
     String s1 = "mytest";
@@ -648,6 +966,1140 @@ TEST(IOTests, Output) {
     check_last_symbol(s2);
 }
 
+TEST(StringViewTests, FromString) {
+    String s = "some text";
+    StringView view = s;
+
+    ASSERT_EQ(s.data(), view.data());
+    ASSERT_EQ(s.size(), view.size());
+    ASSERT_EQ('s', view.front());
+    ASSERT_EQ('t', view.back());
+    ASSERT_EQ(s, String(view));
+}
+
+TEST(StringViewTests, SubstrNoAllocation) {
+    String s(100, 'a');
+    s[50] = 'b';
+    StringView view = s;
+
+    new_count = 0;
+    StringView part = view.substr(40, 20);
+    ASSERT_EQ(0, new_count);
+    ASSERT_EQ(s.data() + 40, part.data());
+    ASSERT_EQ(20, part.size());
+    ASSERT_EQ(10, part.find("b"));
+}
+
+TEST(StringViewTests, FindLiteralNoAllocation) {
+    String s = "this is a rather long text to search in";
+
+    new_count = 0;
+    ASSERT_EQ(10, s.find("rather long text to search"));
+    ASSERT_EQ(5, s.rfind("is"));
+    ASSERT_EQ(s.size(), s.find("missing, but rather long needle"));
+    ASSERT_EQ(0, new_count);
+}
+
+TEST(StringViewTests, FindSemantics) {
+    StringView view = "test";
+
+    ASSERT_EQ(1, view.find("es"));
+    ASSERT_EQ(4, view.find("aboba"));
+    ASSERT_EQ(0, view.find(""));
+    ASSERT_EQ(4, view.rfind(""));
+    ASSERT_EQ(3, view.rfind("t"));
+}
+
+TEST(StringViewTests, Comparison) {
+    String s = "abcd";
+    StringView view = "abce";
+
+    ASSERT_TRUE(view == StringView("abce"));
+    ASSERT_TRUE(s < view);
+    ASSERT_TRUE(view > s);
+    ASSERT_TRUE(s != view);
+    ASSERT_TRUE(StringView(s).substr(0, 3) == view.substr(0, 3));
+    ASSERT_LT(s.compare(view), 0);
+    ASSERT_EQ(String(view).hash(), view.hash());
+}
+
+TEST(StringViewTests, Output) {
+    std::stringstream out;
+    String s = "abcdef";
+    out << StringView(s).substr(1, 3);
+
+    ASSERT_EQ("bcd", out.str());
+}
+
+std::vector<StringView> collect(const SplitRange& range) {
+    std::vector<StringView> pieces;
+    for (StringView piece : range) {
+        pieces.push_back(piece);
+    }
+    return pieces;
+}
+
+TEST(SplitTests, ByChar) {
+    String line = "a,,bc,";
+    std::vector<StringView> pieces = collect(split(line, ','));
+
+    ASSERT_EQ(4, pieces.size());
+    ASSERT_EQ("a", pieces[0]);
+    ASSERT_EQ("", pieces[1]);
+    ASSERT_EQ("bc", pieces[2]);
+    ASSERT_EQ("", pieces[3]);
+    ASSERT_EQ(line.data() + 3, pieces[2].data());
+
+    ASSERT_EQ(1, split("", ',').count());
+    ASSERT_EQ(1, split("abc", ',').count());
+}
+
+TEST(SplitTests, BySeparatorAndCharSet) {
+    std::vector<StringView> pieces = collect(split("key::value::::end", "::"));
+    ASSERT_EQ(4, pieces.size());
+    ASSERT_EQ("value", pieces[1]);
+    ASSERT_EQ("", pieces[2]);
+    ASSERT_EQ("end", pieces[3]);
+
+    pieces = collect(split("a,b", ""));
+    ASSERT_EQ(1, pieces.size());
+    ASSERT_EQ("a,b", pieces[0]);
+
+    // long enough for the SIMD blocks
+    String text = "one;two,three;;four,five;six,seven;eight,nine;ten";
+    pieces = collect(split_any(text, ",;"));
+    ASSERT_EQ(11, pieces.size());
+    ASSERT_EQ("three", pieces[2]);
+    ASSERT_EQ("", pieces[3]);
+    ASSERT_EQ("ten", pieces[10]);
+}
+
+TEST(SplitTests, Whitespace) {
+    String text = "  first\tsecond \n\n third   fourth_word_is_rather_long_one  ";
+    std::vector<StringView> pieces = collect(split_whitespace(text));
+
+    ASSERT_EQ(4, pieces.size());
+    ASSERT_EQ("first", pieces[0]);
+    ASSERT_EQ("third", pieces[2]);
+    ASSERT_EQ("fourth_word_is_rather_long_one", pieces[3]);
+    ASSERT_EQ(0, split_whitespace(" \t ").count());
+    ASSERT_EQ(0, split_whitespace("").count());
+}
+
+TEST(SplitTests, SplitInto) {
+    std::vector<StringView> pieces = {"first"};
+    split("a b c", ' ').split_into(pieces);
+
+    ASSERT_EQ(4, pieces.size());
+    ASSERT_EQ(4, pieces.capacity());
+    ASSERT_EQ("c", pieces[3]);
+}
+
+TEST(MethodTests, FindFirstOf) {
+    String text(100, 'a');
+    text[70] = 'x';
+    text[90] = 'y';
+
+    ASSERT_EQ(70, text.find_first_of("yx"));
+    ASSERT_EQ(90, text.find_first_of("y"));
+    ASSERT_EQ(100, text.find_first_of("bcd"));
+    ASSERT_EQ(100, text.find_first_of(""));
+    ASSERT_EQ(70, text.find_first_of("0123456789xyz"));
+    ASSERT_EQ(1, StringView("a,b").find_first_of(",;"));
+}
+
+TEST(CaseTests, ToLowerUpper) {
+    // letters and their neighbours in the table, long enough for the SIMD blocks
+    String text = "@AZ[`az{ Hello, World! 123 \xc0\xe0 MiXeD cAsE tExT";
+    String lower = "@az[`az{ hello, world! 123 \xc0\xe0 mixed case text";
+    String upper = "@AZ[`AZ{ HELLO, WORLD! 123 \xc0\xe0 MIXED CASE TEXT";
+
+    ASSERT_EQ(lower, to_lower(text));
+    ASSERT_EQ(upper, to_upper(text));
+    ASSERT_EQ(lower, String(text).to_lower());
+    ASSERT_EQ(upper, String(text).to_upper());
+    check_last_symbol(to_lower(text));
+    ASSERT_EQ("", to_lower(""));
+}
+
+TEST(CaseTests, ICompare) {
+    ASSERT_EQ(0, String("Content-Length").icompare("content-LENGTH"));
+    ASSERT_TRUE(String("abc").icompare("ABD") < 0);
+    ASSERT_TRUE(String("abd").icompare("ABC") > 0);
+    ASSERT_TRUE(String("ab").icompare("ABC") < 0);
+    // '_' is between the upper and the lower letters, the lowered order is used
+    ASSERT_TRUE(StringView("_").icompare("A") < 0);
+
+    String long_left(100, 'a'), long_right(100, 'A');
+    ASSERT_EQ(0, long_left.icompare(long_right));
+    long_right[70] = 'B';
+    ASSERT_TRUE(long_left.icompare(long_right) < 0);
+}
+
+TEST(CaseTests, IFind) {
+    String text(100, 'x');
+    text += "Needle";
+    text += String(30, 'y');
+
+    ASSERT_EQ(100, text.ifind("nEEDLE"));
+    ASSERT_EQ(100, text.ifind("needle"));
+    ASSERT_EQ(105, text.ifind("EY"));
+    ASSERT_EQ(text.size(), text.ifind("needles"));
+    ASSERT_EQ(0, text.ifind(""));
+    ASSERT_EQ(1, StringView("aBc").ifind("BC"));
+}
+
+TEST(CaseTests, Trim) {
+    StringView text = " \t value with spaces \r\n";
+
+    ASSERT_EQ("value with spaces", text.trim());
+    ASSERT_EQ("value with spaces \r\n", text.trim_left());
+    ASSERT_EQ(" \t value with spaces", text.trim_right());
+    ASSERT_EQ("", StringView(" \n ").trim());
+    ASSERT_EQ("", StringView().trim());
+}
+
+TEST(NumberTests, AppendInt) {
+    String s = "value=";
+    s.append_int(0).append_int(-42).append_int(123u);
+
+    ASSERT_EQ("value=0-42123", s);
+    check_last_symbol(s);
+
+    String limits;
+    limits.append_int(std::numeric_limits<int64_t>::min());
+    limits += ' ';
+    limits.append_int(std::numeric_limits<uint64_t>::max());
+    ASSERT_EQ("-9223372036854775808 18446744073709551615", limits);
+
+    String exact(100, 'a');
+    exact.shrink_to_fit();
+    new_count = 0;
+    exact.append_int(1234567);
+    ASSERT_EQ(1, new_count);
+    ASSERT_EQ(107, exact.size());
+}
+
+TEST(NumberTests, AppendDouble) {
+    String s;
+    s.append_double(0.1);
+    s += ' ';
+    s.append_double(-2.5e-300);
+    s += ' ';
+    s.append_double(1e21);
+
+    ASSERT_EQ("0.1 -2.5e-300 1e+21", s);
+    check_last_symbol(s);
+
+    double parsed = 0;
+    ASSERT_TRUE(StringView(s).substr(s.rfind(" ") + 1, 5).parse_double(parsed));
+    ASSERT_EQ(1e21, parsed);
+}
+
+TEST(NumberTests, Parse) {
+    int value = 7;
+    ASSERT_TRUE(String("-123").parse_int(value));
+    ASSERT_EQ(-123, value);
+
+    ASSERT_FALSE(String("").parse_int(value));
+    ASSERT_FALSE(String("12a").parse_int(value));
+    ASSERT_FALSE(String(" 12").parse_int(value));
+    ASSERT_FALSE(String("99999999999").parse_int(value));
+    ASSERT_EQ(-123, value);
+
+    uint8_t byte = 0;
+    ASSERT_TRUE(StringView("255").parse_int(byte));
+    ASSERT_FALSE(StringView("256").parse_int(byte));
+    ASSERT_EQ(255, byte);
+
+    double number = 0;
+    ASSERT_TRUE(StringView("3.25").parse_double(number));
+    ASSERT_EQ(3.25, number);
+    ASSERT_FALSE(StringView("3.25.").parse_double(number));
+
+    String round_trip;
+    round_trip.append_double(0.1 + 0.2);
+    ASSERT_TRUE(round_trip.parse_double(number));
+    ASSERT_EQ(0.1 + 0.2, number);
+}
+
+TEST(FormatTests, Arguments) {
+    String name = "request";
+    StringView unit = "ms";
+
+    String line = String::format("{}: {} {} {{{}}} {}{}", name, 42, unit, -1.5, 'x', "!");
+    ASSERT_EQ("request: 42 ms {-1.5} x!", line);
+    check_last_symbol(line);
+
+    ASSERT_EQ("no arguments", String::format("no arguments"));
+    ASSERT_EQ("}{", String::format("}}{{"));
+    ASSERT_EQ("", String::format("{}", ""));
+}
+
+TEST(FormatTests, AppendAllocatesOnce) {
+    String line(30, 'a');
+    line.shrink_to_fit();
+
+    new_count = 0;
+    line.append_format(" {} {}", 1234567890123LL, 0.25);
+    ASSERT_EQ(1, new_count);
+    ASSERT_EQ(String(30, 'a') + " 1234567890123 0.25", line);
+
+    // the argument is the string itself
+    String s = "ab";
+    s.append_format("[{}]", s);
+    ASSERT_EQ("ab[ab]", s);
+    check_last_symbol(s);
+}
+
+TEST(FormatTests, CheckedFormat) {
+    constexpr FormatString<int, int> POINT = "({}, {})";
+    ASSERT_EQ("(1, 2)", String::format(POINT, 1, 2));
+
+#if !defined(__cpp_consteval)
+    // checked when the format is made at run time
+    ASSERT_THROW(String::format("{} {}", 1), std::invalid_argument);
+    ASSERT_THROW(String::format("{", 1), std::invalid_argument);
+    ASSERT_THROW(String::format("{} }", 1), std::invalid_argument);
+#endif
+}
+
+TEST(SearcherTests, FindAndRFind) {
+    String::Searcher searcher("ab");
+    String s1 = "cabab", s2 = "ba";
+
+    ASSERT_EQ(1, searcher.find_in(s1));
+    ASSERT_EQ(3, searcher.rfind_in(s1));
+    ASSERT_EQ(s2.size(), searcher.find_in(s2));
+    ASSERT_EQ(s2.size(), searcher.rfind_in(s2));
+}
+
+TEST(SearcherTests, LongNeedle) {
+    String needle(40, 'a');
+    needle += 'b';
+    String::Searcher searcher(needle);
+    String s = String(10, 'a') + needle + String(5, 'c') + needle;
+
+    ASSERT_EQ(s.find(needle), searcher.find_in(s));
+    ASSERT_EQ(s.rfind(needle), searcher.rfind_in(s));
+    ASSERT_EQ(std::vector<size_t>({10, 56}), searcher.find_all(s));
+}
+
+TEST(SearcherTests, RareFilterBytes) {
+    // the searcher filters by the rarest needle bytes, which are not the first and the last ones here
+    String text;
+    for (size_t i = 0; i < 300; ++i) {
+        text += i % 7 == 0 ? "Word_" : "text ";
+        text += static_cast<char>('0' + i % 10);
+    }
+    std::string model(text.data());
+
+    for (size_t begin = 0; begin < text.size(); begin += 29) {
+        for (size_t length = 2; length <= 40 && begin + length <= text.size(); length += 5) {
+            String needle = text.substr(begin, length);
+            String::Searcher searcher(needle);
+
+            std::vector<size_t> expected;
+            for (size_t found = model.find(needle.data()); found != std::string::npos;
+                    found = model.find(needle.data(), found + 1)) {
+                expected.push_back(found);
+            }
+            ASSERT_EQ(expected, searcher.find_all(text));
+        }
+    }
+    ASSERT_EQ(text.size(), String::Searcher("Word_0Word_").find_in(text));
+}
+
+TEST(SearcherTests, FindAllOverlapping) {
+    String::Searcher searcher("aa");
+
+    ASSERT_EQ(std::vector<size_t>({0, 1, 2}), searcher.find_all("aaaa"));
+    ASSERT_TRUE(searcher.find_all("bab").empty());
+    ASSERT_TRUE(searcher.find_all("").empty());
+}
+
+TEST(SearcherTests, FindAllEmptyNeedle) {
+    String::Searcher searcher("");
+
+    ASSERT_EQ(std::vector<size_t>({0, 1, 2}), searcher.find_all("ab"));
+    ASSERT_EQ(0, searcher.find_in("ab"));
+    ASSERT_EQ(2, searcher.rfind_in("ab"));
+}
+
+String make_search_text(size_t size) {
+    String text(size, 'a');
+    for (size_t i = 0; i < size; ++i) {
+        text[i] = 'a' + (i * 7 + i / 13) % 3;
+    }
+    return text;
+}
+
+TEST(ParallelSearchTests, SameAsSequential) {
+    String text = make_search_text(1000);
+    const char* needles[] = {"a", "ab", "abc", "cab", "bcab", "abcabca", "zz"};
+
+    for (const char* needle : needles) {
+        String::Searcher searcher(needle);
+        // tiny blocks, so matches cross block borders all the time
+        ParallelSearcher parallel(needle, 4, 7);
+
+        ASSERT_EQ(text.find(needle), parallel.find_in(text));
+        ASSERT_EQ(text.rfind(needle), parallel.rfind_in(text));
+        ASSERT_EQ(searcher.find_all(text), parallel.find_all(text));
+        ASSERT_EQ(searcher.find_all(text).size(), parallel.count(text));
+    }
+}
+
+TEST(ParallelSearchTests, SingleMatch) {
+    String text(10000, 'a');
+    text[5000] = 'b';
+    text[5001] = 'c';
+    ParallelSearcher parallel("bc", 8, 100);
+
+    ASSERT_EQ(5000, parallel.find_in(text));
+    ASSERT_EQ(5000, parallel.rfind_in(text));
+    ASSERT_EQ(std::vector<size_t>{5000}, parallel.find_all(text));
+    ASSERT_EQ(1, parallel.count(text));
+}
+
+TEST(ParallelSearchTests, EdgeCases) {
+    String text = "abcabc";
+    ParallelSearcher empty("", 4, 2);
+    ParallelSearcher longer("abcabcabc", 4, 2);
+
+    ASSERT_EQ(0, empty.find_in(text));
+    ASSERT_EQ(6, empty.rfind_in(text));
+    ASSERT_EQ(7, empty.count(text));
+    ASSERT_EQ(6, longer.find_in(text));
+    ASSERT_EQ(6, longer.rfind_in(text));
+    ASSERT_EQ(0, longer.count(text));
+    ASSERT_EQ(3, ParallelSearcher("abc", 4, 2).rfind_in(text));
+}
+
+TEST(AhoCorasickTests, Classic) {
+    AhoCorasick matcher({"he", "she", "his", "hers"});
+    auto matches = matcher.find_all("ushers");
+
+    ASSERT_EQ(3, matches.size());
+    ASSERT_EQ(1, matches[0].pattern_id);
+    ASSERT_EQ(1, matches[0].position);
+    ASSERT_EQ(0, matches[1].pattern_id);
+    ASSERT_EQ(2, matches[1].position);
+    ASSERT_EQ(3, matches[2].pattern_id);
+    ASSERT_EQ(2, matches[2].position);
+}
+
+TEST(AhoCorasickTests, MatchesSearcher) {
+    std::vector<String> patterns = {"a", "ab", "bab", "aab", "b", "abba", "ab"};
+    String text;
+    for (size_t i = 0; i < 200; ++i) {
+        text.push_back('a' + (i * 5 + i / 7) % 2);
+    }
+
+    std::vector<std::vector<size_t>> found(patterns.size());
+    AhoCorasick matcher(patterns);
+    matcher.for_each_match(text, [&found](const AhoCorasick::Match& match) {
+        found[match.pattern_id].push_back(match.position);
+    });
+
+    for (size_t id = 0; id < patterns.size(); ++id) {
+        std::sort(found[id].begin(), found[id].end());
+        ASSERT_EQ(String::Searcher(patterns[id]).find_all(text), found[id]);
+    }
+}
+
+TEST(AhoCorasickTests, NoMatches) {
+    AhoCorasick matcher({"xyz", "zz"});
+
+    ASSERT_EQ(2, matcher.pattern_count());
+    ASSERT_TRUE(matcher.find_all("abcxyabczy").empty());
+    ASSERT_TRUE(matcher.find_all("").empty());
+}
+
+TEST(AhoCorasickTests, EmptyPattern) {
+    AhoCorasick matcher({""});
+
+    ASSERT_EQ(3, matcher.find_all("ab").size());
+}
+
+TEST(AllocatorTests, ArenaBypassesHeap) {
+    ArenaStringAllocator arena;
+
+    new_count = 0;
+    for (size_t i = 0; i < 100; ++i) {
+        String s(100, 'a', &arena);
+        s += s;
+        ASSERT_EQ(200, s.size());
+        check_last_symbol(s);
+    }
+    // the only allocation is the arena block itself
+    ASSERT_EQ(1, new_count);
+    ASSERT_EQ(ArenaStringAllocator::DEFAULT_BLOCK_SIZE, arena.reserved());
+}
+
+TEST(AllocatorTests, ArenaReset) {
+    ArenaStringAllocator arena(1024);
+    const char* first;
+    {
+        String s(100, 'a', &arena);
+        first = s.data();
+    }
+    arena.reset();
+
+    new_count = 0;
+    String s(500, 'b', &arena);
+    ASSERT_EQ(0, new_count);
+    ASSERT_EQ(first, s.data());
+}
+
+TEST(AllocatorTests, ArenaLargeAllocation) {
+    ArenaStringAllocator arena(64);
+    String s(1000, 'a', &arena);
+    String t(40, 'b', &arena);
+
+    ASSERT_EQ(String(1000, 'a'), s);
+    ASSERT_EQ(String(40, 'b'), t);
+    ASSERT_EQ(1001 + 64, arena.reserved());
+}
+
+TEST(AllocatorTests, PoolReusesBuffers) {
+    PoolStringAllocator pool;
+    const char* first;
+    {
+        String s(100, 'a', &pool);
+        first = s.data();
+    }
+
+    new_count = 0;
+    String s(90, 'b', &pool);
+    ASSERT_EQ(0, new_count);
+    ASSERT_EQ(first, s.data());
+
+    String large(PoolStringAllocator::MAX_CLASS_SIZE * 2, 'c', &pool);
+    ASSERT_EQ(1, new_count);
+    check_last_symbol(large);
+}
+
+TEST(AllocatorTests, SizeClassFreeLists) {
+    ASSERT_EQ(32, SizeClassFreeLists::class_size(1));
+    ASSERT_EQ(64, SizeClassFreeLists::class_size(33));
+    ASSERT_EQ(SizeClassFreeLists::MAX_CLASS_SIZE, SizeClassFreeLists::class_size(SizeClassFreeLists::MAX_CLASS_SIZE));
+
+    char first[64], second[64];
+    SizeClassFreeLists free_lists;
+    free_lists.push(first, 40);
+    free_lists.push(second, 64);
+    ASSERT_EQ(nullptr, free_lists.pop(32));
+
+    // the last freed buffer of the class comes first
+    ASSERT_EQ(second, free_lists.pop(50));
+    free_lists.push(second, 64);
+
+    std::vector<char*> released;
+    free_lists.clear([&released](char* buffer) {
+        released.push_back(buffer);
+    });
+    ASSERT_EQ(2, released.size());
+    ASSERT_EQ(nullptr, free_lists.pop(64));
+}
+
+TEST(AllocatorTests, Propagation) {
+    ArenaStringAllocator arena;
+    String s("a string long enough to leave the local buffer", &arena);
+
+    String copy = s;
+    ASSERT_EQ(nullptr, copy.get_allocator());
+
+    String assigned(&arena);
+    assigned = copy;
+    ASSERT_EQ(&arena, assigned.get_allocator());
+    ASSERT_EQ(s, assigned);
+
+    String moved = std::move(s);
+    ASSERT_EQ(&arena, moved.get_allocator());
+
+    copy = std::move(moved);
+    ASSERT_EQ(nullptr, copy.get_allocator());
+    ASSERT_EQ(assigned, copy);
+}
+
+TEST(RopeTests, Basic) {
+    Rope rope("hello world");
+    rope.insert(5, ",");
+    rope += "!";
+    rope.erase(0, 1);
+    rope.insert(0, "H");
+
+    ASSERT_EQ(13, rope.size());
+    ASSERT_EQ('H', rope[0]);
+    ASSERT_EQ(',', rope[5]);
+    ASSERT_EQ("Hello, world!", rope.to_string());
+    check_last_symbol(rope.to_string());
+}
+
+TEST(RopeTests, SplitAndConcat) {
+    Rope rope(String(3000, 'a'));
+    Rope tail = rope.split(1000);
+
+    ASSERT_EQ(1000, rope.size());
+    ASSERT_EQ(2000, tail.size());
+
+    rope += Rope("b");
+    rope += std::move(tail);
+    ASSERT_EQ(3001, rope.size());
+    ASSERT_EQ('b', rope[1000]);
+    ASSERT_TRUE(tail.empty());
+}
+
+TEST(RopeTests, MatchesStdString) {
+    std::string model;
+    Rope rope;
+    unsigned seed = 1;
+    auto random = [&seed](size_t bound) {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 8) % bound;
+    };
+
+    for (size_t step = 0; step < 300; ++step) {
+        size_t position = random(model.size() + 1);
+        if (random(3) == 0 && !model.empty()) {
+            size_t count = random(model.size() - position + 1);
+            model.erase(position, count);
+            rope.erase(position, count);
+        } else {
+            std::string text(random(40) + 1, 'a' + random(3));
+            model.insert(position, text);
+            rope.insert(position, text.c_str());
+        }
+    }
+
+    ASSERT_EQ(String(model.c_str()), rope.to_string());
+    for (size_t i = 0; i < model.size(); i += 17) {
+        ASSERT_EQ(model[i], rope[i]);
+    }
+}
+
+TEST(RopeTests, ManySmallInserts) {
+    // equal priorities of the inserted nodes made the treap a list:
+    // quadratic time and a stack overflow in the recursive merge
+    const size_t COUNT = 100000;
+    std::string model;
+    Rope rope;
+
+    for (size_t i = 0; i < COUNT; ++i) {
+        char piece[] = {static_cast<char>('a' + i % 26), TERMINATE_SYMBOL};
+        size_t position = i % 3 == 0 ? 0 : (i % 3 == 1 ? rope.size() : rope.size() / 2);
+        model.insert(position, piece);
+        rope.insert(position, piece);
+    }
+
+    ASSERT_EQ(COUNT, rope.size());
+    ASSERT_EQ(String(model.c_str()), rope.to_string());
+}
+
+TEST(RopeTests, SmallInsertsShareChunks) {
+    // pieces too long for the local buffer, so every new chunk takes a new[]
+    const size_t COUNT = 1000;
+    String piece(32, 'x');
+    Rope rope;
+
+    new_count = 0;
+    for (size_t i = 0; i < COUNT; ++i) {
+        rope.insert(rope.size(), piece);
+    }
+
+    // the pieces fill chunks of up to 1024 chars, which grow geometrically
+    ASSERT_TRUE(new_count < static_cast<int>(COUNT / 2));
+    ASSERT_EQ(String(COUNT * piece.size(), 'x'), rope.to_string());
+}
+
+TEST(RopeTests, FindAcrossChunks) {
+    Rope rope;
+    for (size_t i = 0; i < 50; ++i) {
+        rope += String(i % 3 == 0 ? "ab" : "c");
+    }
+    String flat = rope.to_string();
+
+    const char* needles[] = {"", "a", "ab", "bc", "cab", "ccab", "abcab", "bcabccab", "zz"};
+    for (const char* needle : needles) {
+        ASSERT_EQ(flat.find(needle), rope.find(needle));
+        ASSERT_EQ(flat.rfind(needle), rope.rfind(needle));
+    }
+}
+
+TEST(RopeTests, FindLongText) {
+    String text(5000, 'a');
+    text[1023] = 'b';
+    text[1024] = 'c';
+    text[4000] = 'b';
+    text[4001] = 'c';
+    Rope rope(text);
+
+    ASSERT_EQ(1023, rope.find("bc"));
+    ASSERT_EQ(4000, rope.rfind("bc"));
+    ASSERT_EQ(rope.size(), rope.find("cb"));
+}
+
+const char* MAPPED_PATH = "mapped_string_test.txt";
+
+void write_file(const char* path, const char* text) {
+    std::ofstream out(path, std::ios::binary);
+    out << text;
+}
+
+TEST(MappedStringTests, Contents) {
+    write_file(MAPPED_PATH, "first line\nsecond line\n");
+    {
+        MappedString file(MAPPED_PATH);
+
+        ASSERT_EQ(23, file.size());
+        ASSERT_EQ('f', file[0]);
+        ASSERT_EQ('\n', file.back());
+        ASSERT_EQ(11, file.find("second"));
+        ASSERT_EQ(18, file.rfind("line"));
+        ASSERT_EQ("second", file.substr(11, 6));
+        ASSERT_EQ(file.data() + 11, file.substr(11, 6).data());
+        ASSERT_TRUE(file == "first line\nsecond line\n");
+        ASSERT_TRUE(file < String("g"));
+        ASSERT_EQ(String("first line\nsecond line\n").hash(), file.hash());
+
+        std::stringstream out;
+        out << file;
+        ASSERT_EQ("first line\nsecond line\n", out.str());
+    }
+    std::remove(MAPPED_PATH);
+}
+
+TEST(MappedStringTests, EmptyFile) {
+    write_file(MAPPED_PATH, "");
+    {
+        MappedString file(MAPPED_PATH, MappedString::AccessPattern::RANDOM);
+
+        ASSERT_TRUE(file.empty());
+        ASSERT_TRUE(file == "");
+        ASSERT_EQ(0, file.find(""));
+    }
+    std::remove(MAPPED_PATH);
+}
+
+TEST(MappedStringTests, MissingFile) {
+    ASSERT_THROW(MappedString("no_such_file.txt"), std::system_error);
+}
+
+TEST(MappedStringTests, Move) {
+    write_file(MAPPED_PATH, "text");
+    {
+        MappedString file(MAPPED_PATH);
+        MappedString moved = std::move(file);
+
+        ASSERT_TRUE(file.empty());
+        ASSERT_TRUE(moved == "text");
+
+        file = std::move(moved);
+        ASSERT_TRUE(file == "text");
+    }
+    std::remove(MAPPED_PATH);
+}
+
+TEST(SharedStringTests, CopyShares) {
+    SharedString s1 = "some long shared text";
+
+    new_count = 0;
+    SharedString s2 = s1;
+    const SharedString& s3 = s2;
+    ASSERT_EQ(0, new_count);
+    ASSERT_EQ(2, s1.use_count());
+    ASSERT_EQ(StringView(s1).data(), StringView(s2).data());
+    ASSERT_EQ('s', s3[0]);
+    ASSERT_EQ(0, new_count);
+}
+
+TEST(SharedStringTests, DetachOnChange) {
+    SharedString s1 = "text";
+    SharedString s2 = s1;
+
+    s2[0] = 'n';
+    ASSERT_EQ("text", s1);
+    ASSERT_EQ("next", s2);
+    ASSERT_EQ(1, s1.use_count());
+    ASSERT_EQ(1, s2.use_count());
+
+    SharedString s3 = s1;
+    s3 += "ure";
+    s3.push_back('s');
+    ASSERT_EQ("text", s1);
+    ASSERT_EQ("textures", s3);
+
+    SharedString s4 = s3;
+    s4.pop_back();
+    ASSERT_EQ("texture", s4);
+    ASSERT_EQ('\0', s4.data()[s4.size()]);
+
+    SharedString s5 = s4;
+    s5.clear();
+    ASSERT_TRUE(s5.empty());
+    ASSERT_EQ("texture", s4);
+}
+
+TEST(SharedStringTests, UniqueChangeInPlace) {
+    SharedString s = "abc";
+    s.push_back('d');
+    const char* before = StringView(s).data();
+
+    new_count = 0;
+    s[0] = 'x';
+    s.pop_back();
+    ASSERT_EQ(0, new_count);
+    ASSERT_EQ(before, StringView(s).data());
+    ASSERT_EQ("xbc", s);
+}
+
+TEST(SharedStringTests, AppendSelf) {
+    SharedString s = "ab";
+    SharedString copy = s;
+    s += s;
+    s += StringView(s).substr(1, 2);
+
+    ASSERT_EQ("ababba", s);
+    ASSERT_EQ("ab", copy);
+}
+
+TEST(SharedStringTests, SearchAndCompare) {
+    SharedString s = "abcabc";
+
+    ASSERT_EQ(1, s.find("bc"));
+    ASSERT_EQ(4, s.rfind("bc"));
+    ASSERT_TRUE(s < SharedString("abd"));
+    ASSERT_EQ(String("abcabc").hash(), s.hash());
+    ASSERT_EQ(String("abcabc"), s.to_string());
+}
+
+TEST(SharedStringTests, ConcurrentCopies) {
+    SharedString shared(String(1000, 'x'));
+    std::vector<std::thread> workers;
+
+    for (size_t i = 0; i < 4; ++i) {
+        workers.emplace_back([&shared]() {
+            for (size_t j = 0; j < 10000; ++j) {
+                const SharedString copy = shared;
+                if (copy.size() != 1000 || copy[999] != 'x') abort();
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    ASSERT_EQ(1, shared.use_count());
+}
+
+TEST(InternPoolTests, SameTextSameHandle) {
+    StringInternPool pool;
+    String key = "field_name";
+
+    InternedString first = pool.intern(key);
+    InternedString second = pool.intern("field_name");
+    InternedString other = pool.intern("other_name");
+
+    ASSERT_TRUE(first == second);
+    ASSERT_TRUE(first != other);
+    ASSERT_EQ(first.data(), second.data());
+    ASSERT_EQ(key.hash(), first.hash());
+    ASSERT_EQ("field_name", first.view());
+    ASSERT_EQ(2, pool.size());
+}
+
+TEST(InternPoolTests, Empty) {
+    StringInternPool pool;
+
+    ASSERT_TRUE(pool.intern("") == InternedString());
+    ASSERT_TRUE(InternedString().empty());
+    ASSERT_EQ(String().hash(), InternedString().hash());
+    ASSERT_EQ(0, pool.size());
+}
+
+TEST(InternPoolTests, AsMapKey) {
+    StringInternPool pool;
+    std::unordered_map<InternedString, int> counts;
+    const char* words[] = {"a", "b", "a", "c", "a", "b"};
+
+    for (const char* word : words) {
+        ++counts[pool.intern(word)];
+    }
+    ASSERT_EQ(3, counts[pool.intern("a")]);
+    ASSERT_EQ(2, counts[pool.intern("b")]);
+    ASSERT_EQ(1, counts[pool.intern("c")]);
+}
+
+TEST(InternPoolTests, ConcurrentIntern) {
+    StringInternPool pool;
+    std::vector<std::thread> workers;
+    std::vector<std::vector<InternedString>> results(4);
+
+    for (size_t i = 0; i < 4; ++i) {
+        workers.emplace_back([&pool, &results, i]() {
+            for (size_t j = 0; j < 1000; ++j) {
+                String text = "tag_";
+                text += static_cast<char>('a' + j % 26);
+                text += static_cast<char>('a' + j / 26 % 26);
+                results[i].push_back(pool.intern(text));
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    ASSERT_EQ(676, pool.size());
+    for (size_t i = 1; i < 4; ++i) {
+        ASSERT_TRUE(results[0] == results[i]);
+    }
+}
+
+#ifdef STRING_INSTRUMENTATION
+TEST(StatsTests, Allocations) {
+    String::reset_stats();
+    {
+        String s(100, 'a');
+        s.reserve(1000);
+    }
+    StringStats stats = String::stats();
+
+    ASSERT_EQ(2, stats.allocations);
+    ASSERT_EQ(2, stats.deallocations);
+    ASSERT_EQ(101 + 1001, stats.allocated_bytes);
+    ASSERT_EQ(1, stats.reallocations);
+    ASSERT_EQ(100, stats.reallocation_bytes_copied);
+    ASSERT_EQ(900, stats.wasted_bytes);
+}
+
+TEST(StatsTests, Calls) {
+    String s = "abc";
+    String::reset_stats();
+
+    s.find("b");
+    s.rfind("b");
+    s.substr(0, 1);
+    s += 'd';
+    s += "ef";
+
+    StringStats stats = String::stats();
+    ASSERT_EQ(1, stats.find_calls);
+    ASSERT_EQ(1, stats.rfind_calls);
+    ASSERT_EQ(1, stats.substr_calls);
+    ASSERT_EQ(2, stats.append_calls);
+    ASSERT_EQ(0, stats.allocations);
+}
+
+TEST(StatsTests, PerThread) {
+    String::reset_stats();
+    std::thread([]() {
+        String s(100, 'a');
+    }).join();
+
+    ASSERT_EQ(0, String::stats().allocations);
+}
+#else
+TEST(StatsTests, Disabled) {
+    String s(100, 'a');
+    s.find("a");
+
+    ASSERT_EQ(0, String::stats().allocations);
+    ASSERT_EQ(0, String::stats().find_calls);
+}
+#endif
+
+TEST(BufferPoolTests, Reuse) {
+    StringBufferPool pool;
+
+    char* first = pool.allocate(100);
+    pool.deallocate(first, 100);
+    // 100 and 120 are in the same size class
+    char* second = pool.allocate(120);
+
+    ASSERT_EQ(first, second);
+    StringBufferPool::Stats stats = pool.stats();
+    ASSERT_EQ(1, stats.hits);
+    ASSERT_EQ(1, stats.misses);
+    ASSERT_EQ(1, stats.returned);
+    ASSERT_EQ(0, stats.retained_bytes);
+
+    pool.deallocate(second, 120);
+    ASSERT_EQ(128, pool.stats().retained_bytes);
+    pool.release();
+    ASSERT_EQ(0, pool.stats().retained_bytes);
+}
+
+TEST(BufferPoolTests, Limit) {
+    StringBufferPool pool(100);
+    char* small = pool.allocate(40);
+    char* other = pool.allocate(40);
+    char* large = pool.allocate(10000);
+
+    pool.deallocate(small, 40);
+    pool.deallocate(other, 40);
+    pool.deallocate(large, 10000);
+
+    StringBufferPool::Stats stats = pool.stats();
+    ASSERT_EQ(1, stats.returned);
+    ASSERT_EQ(1, stats.dropped);
+    ASSERT_EQ(64, stats.retained_bytes);
+}
+
+#ifdef STRING_BUFFER_POOL
+TEST(BufferPoolTests, StringsReuseBuffers) {
+    StringBufferPool* pool = StringBufferPool::local();
+    pool->set_max_retained_bytes(StringBufferPool::DEFAULT_MAX_RETAINED_BYTES);
+
+    new_count = 0;
+    for (size_t i = 0; i < 10; ++i) {
+        String s(100, 'a');
+        s += "tail";
+    }
+    // only the first string takes its two buffers from new[]
+    ASSERT_EQ(2, new_count);
+    ASSERT_EQ(18, pool->stats().hits);
+
+    pool->set_max_retained_bytes(0);
+    pool->release();
+}
+#endif
+
+TEST(MoveTests, Constructor) {
+    String source(50, 'a');
+    const char* data = source.data();
+
+    new_count = 0;
+    String s = std::move(source);
+    ASSERT_EQ(0, new_count);
+    ASSERT_EQ(data, s.data());
+    ASSERT_EQ(String(50, 'a'), s);
+    ASSERT_TRUE(source.empty());
+    check_last_symbol(source);
+}
+
+TEST(MoveTests, ConstructorLocal) {
+    String source = "abc";
+    String s = std::move(source);
+
+    ASSERT_EQ("abc", s);
+    ASSERT_TRUE(source.empty());
+    check_last_symbol(s);
+}
+
+TEST(MoveTests, Assign) {
+    String source(50, 'a'), s = "old";
+
+    new_count = 0;
+    s = std::move(source);
+    ASSERT_EQ(0, new_count);
+    ASSERT_EQ(String(50, 'a'), s);
+    check_last_symbol(s);
+}
+
+TEST(MoveTests, PlusChain) {
+    String a(20, 'a'), b(20, 'b'), c(20, 'c'), d(20, 'd');
+    String expected = a;
+    expected += b;
+    expected += c;
+    expected += d;
+
+    // a + b is allocated exactly, then the temporary grows: doubling
+    // fits both c and d at once, the 1.5x policies need one more step
+    int max_allocations = STRING_GROWTH_POLICY == String::GrowthPolicy::DOUBLE ? 2 : 3;
+
+    new_count = 0;
+    String result = a + b + c + d;
+    ASSERT_LE(new_count, max_allocations);
+    ASSERT_EQ(expected, result);
+    check_last_symbol(result);
+}
+
+TEST(MoveTests, PlusCharTemporary) {
+    String result = String("ab") + 'c' + String("de") + 'f';
+
+    ASSERT_EQ("abcdef", result);
+    check_last_symbol(result);
+}
+
+TEST(SmallStringTests, ShortNoAllocation) {
+    new_count = 0;
+    String s1;
+    String s2 = "short key";
+    String s3(10, 'a');
+    String s4 = s2;
+    s4 += s3;
+    s4.push_back('b');
+
+    ASSERT_EQ(0, new_count);
+    ASSERT_EQ("short keyaaaaaaaaaab", s4);
+    check_last_symbol(s4);
+}
+
+TEST(SmallStringTests, LocalLimit) {
+    // 21 chars and the terminating one fill the space of a heap pointer and two sizes
+    new_count = 0;
+    String longest(21, 'a');
+    ASSERT_EQ(0, new_count);
+    longest += 'b';
+    ASSERT_EQ(1, new_count);
+
+    String shortest_heap(22, 'a');
+    ASSERT_EQ(2, new_count);
+    ASSERT_EQ(22, shortest_heap.capacity());
+    check_last_symbol(longest);
+    check_last_symbol(shortest_heap);
+
+#ifndef STRING_CACHED_HASH
+    ASSERT_EQ(sizeof(char*) + 2 * sizeof(size_t) + sizeof(StringAllocator*), sizeof(String));
+#endif
+}
+
+TEST(SmallStringTests, LongAllocatesOnce) {
+    new_count = 0;
+    String s = "this string is definitely too long to be local";
+
+    ASSERT_EQ(1, new_count);
+    check_last_symbol(s);
+}
+
+TEST(SmallStringTests, GrowToHeap) {
+    String s = "abc";
+    for (size_t i = 0; i < 100; ++i) {
+        s.push_back('a' + i % 26);
+    }
+
+    ASSERT_EQ(103, s.size());
+    ASSERT_EQ('a', s[3]);
+    ASSERT_EQ('v', s.back());
+    check_last_symbol(s);
+}
+
+TEST(SmallStringTests, ShrinkToLocal) {
+    String s(100, 'a');
+    s.clear();
+    s += "abc";
+    s.shrink_to_fit();
+
+    new_count = 0;
+    String copy = s;
+    ASSERT_EQ(0, new_count);
+    ASSERT_EQ("abc", s);
+    ASSERT_EQ(3, s.capacity());
+    check_last_symbol(s);
+}
+
+TEST(SmallStringTests, AssignBetweenModes) {
+    String small = "small", large(50, 'l');
+    String s = small;
+    s = large;
+    ASSERT_EQ(large, s);
+
+    s = small;
+    ASSERT_EQ(small, s);
+    check_last_symbol(s);
+}
+
 std::streambuf* move_cerr_to_other_stringstream(std::stringstream& other) {
     std::streambuf* old = std::cerr.rdbuf();
     std::cerr.rdbuf(other.rdbuf());